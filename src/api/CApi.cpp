@@ -0,0 +1,75 @@
+#include "CApi.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "../files/SolutionFile.h"
+#include "../utils/Multithread.h"
+
+struct tok_tokenizer {
+	SolutionFile tkn;
+	// Started on the first batch, so loading alone doesn't spawn threads in the host process
+	std::once_flag pool_once;
+	std::unique_ptr <ThreadPool> pool;
+
+	explicit tok_tokenizer(const char *path) : tkn(path) {}
+
+	ThreadPool &GetPool() {
+		std::call_once(pool_once, [this] { pool = std::make_unique <ThreadPool>(); });
+		return *pool;
+	}
+};
+
+tok_tokenizer *tok_load(const char *path) {
+	if (path == nullptr) return nullptr;
+	try {
+		auto tok = std::make_unique <tok_tokenizer>(path);
+		if (!tok->tkn.GetVocab().IsValid()) return nullptr;
+		return tok.release();
+	}
+	catch (...) {
+		return nullptr;
+	}
+}
+
+size_t tok_encode_batch(tok_tokenizer *tok, const char *const *texts, const size_t *lengths, const size_t count,
+                        uint32_t *ids, const size_t capacity, size_t *offsets) {
+	try {
+		std::vector <std::string_view> docs(count);
+		for (size_t i = 0; i < count; i++) {
+			docs[i] = {texts[i], lengths[i]};
+		}
+		const SolutionFile::TokenizedBatch batch = tok->tkn.TokenizeBatch(docs, tok->GetPool());
+		std::copy(batch.offsets.begin(), batch.offsets.end(), offsets);
+		memcpy(ids, batch.ids.data(), std::min(batch.ids.size(), capacity) * sizeof(uint32_t));
+		return batch.ids.size();
+	}
+	catch (...) {
+		std::fill_n(offsets, count + 1, 0);
+		return 0;
+	}
+}
+
+size_t tok_decode(const tok_tokenizer *tok, const uint32_t *ids, const size_t count, char *text,
+                  const size_t capacity) {
+	try {
+		const std::string decoded = tok->tkn.Detokenize(std::span <const uint32_t>(ids, count));
+		const size_t copied = std::min(decoded.size(), capacity);
+		if (copied != 0) memcpy(text, decoded.data(), copied);
+		if (copied < capacity) text[copied] = '\0';
+		return decoded.size();
+	}
+	catch (...) {
+		if (capacity != 0) text[0] = '\0';
+		return 0;
+	}
+}
+
+void tok_free(tok_tokenizer *tok) {
+	delete tok;
+}
@@ -0,0 +1,61 @@
+#ifndef TOKENIZER_CAPI_H
+#define TOKENIZER_CAPI_H
+
+/*
+ * C interface of tokenizer_core, for linking from C and through FFI.
+ * Every buffer is owned by the caller, so no memory crosses the boundary except the tokenizer handle.
+ * A handle may be used from several threads at once. Functions never throw.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define TOK_API __attribute__((visibility("default")))
+#else
+#define TOK_API
+#endif
+
+/* Bumped on every incompatible change to the functions below */
+#define TOK_API_VERSION 1
+
+typedef struct tok_tokenizer tok_tokenizer;
+
+/**
+ * Loads a .tokens.json vocabulary, or its compiled .tokens.bin twin when it is up to date
+ * @return The handle, or NULL if the vocabulary can't be loaded
+ */
+TOK_API tok_tokenizer *tok_load(const char *path);
+
+/**
+ * Tokenizes many documents on a thread pool owned by the handle, each into ids from <START> to <END>
+ * @param texts, lengths The UTF-8 bytes of each document, which need not be NUL terminated
+ * @param ids Receives the ids of all documents back to back. sum(lengths) + 2 * count ids always suffice.
+ * @param offsets Receives count + 1 entries: document i owns ids[offsets[i]] up to ids[offsets[i + 1]]
+ * @return The number of ids of the whole batch. If it is larger than capacity, only the first capacity ids
+ *		were written, but offsets are complete.
+ */
+TOK_API size_t tok_encode_batch(tok_tokenizer *tok, const char *const *texts, const size_t *lengths, size_t count,
+                                uint32_t *ids, size_t capacity, size_t *offsets);
+
+/**
+ * Turns ids back into text. Ids outside the vocabulary become <UNKNOWN>.
+ * @param text Receives the bytes, followed by a NUL if there is room for it
+ * @return The length of the text without the NUL. If it is at least capacity, the text was cut short.
+ */
+TOK_API size_t tok_decode(const tok_tokenizer *tok, const uint32_t *ids, size_t count, char *text, size_t capacity);
+
+/**
+ * Releases a handle from tok_load. NULL is ignored.
+ */
+TOK_API void tok_free(tok_tokenizer *tok);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+#include "SimdCheck.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <utf8cpp/utf8.h>
+
+#include "../encoder/CaseFold.h"
+#include "../tokenizer/GetTokens.h"
+#include "../tokenizer/Trie.h"
+#include "../utils/CpuFeatures.h"
+
+// Code point ranges the kernels treat differently: ASCII letters and others, then by encoded length, with and without
+// a lowercase mapping
+constexpr char32_t kAsciiRanges[][2] = {{'A', 'Z'}, {'a', 'z'}, {'0', '9'}, {' ', '/'}};
+constexpr char32_t kWideRanges[][2] = {
+	{0xC0, 0xDE}, {0x100, 0x17F}, {0x391, 0x3A9}, {0x410, 0x44F}, {0x531, 0x556}, // 2 bytes
+	{0x1E00, 0x1EFF}, {0x4E00, 0x4FFF}, {0xFF21, 0xFF3A},                        // 3 bytes
+	{0x10400, 0x10427}, {0x1F600, 0x1F64F}                                       // 4 bytes
+};
+// Longest ASCII run between multi-byte sequences, past the widest register so every offset in it is hit
+constexpr size_t kMaxRun = 72;
+// Mismatches printed, the rest are only counted
+constexpr size_t kMaxReports = 5;
+
+template <size_t N>
+char32_t Pick(std::mt19937_64 &rng, const char32_t (&ranges)[N][2]) {
+	const auto &range = ranges[rng() % N];
+	return range[0] + rng() % (range[1] - range[0] + 1);
+}
+
+// Valid UTF-8 of runs of ASCII, each followed by a few multi-byte sequences
+std::string RandomText(std::mt19937_64 &rng, const size_t size) {
+	std::string text;
+	while (text.size() < size) {
+		for (size_t run = rng() % (kMaxRun + 1); run > 0; run--) {
+			text += (char)Pick(rng, kAsciiRanges);
+		}
+		for (size_t wide = rng() % 3; wide > 0; wide--) {
+			utf8::append(Pick(rng, kWideRanges), std::back_inserter(text));
+		}
+	}
+	return text;
+}
+
+// Stray continuation bytes, invalid lead bytes and sequences cut short, which folding has to copy unchanged
+void Corrupt(std::mt19937_64 &rng, std::string &text) {
+	for (size_t errors = rng() % 4; errors > 0 && !text.empty(); errors--) {
+		const size_t pos = rng() % text.size();
+		switch (rng() % 3) {
+		case 0: text[pos] = (char)(0x80 + rng() % 0x40);
+			break;
+		case 1: text[pos] = (char)(0xF8 + rng() % 8);
+			break;
+		default: text.erase(pos, 1);
+		}
+	}
+}
+
+// Sorted distinct code points, either dense like the children of a busy node or spread over the whole range
+std::vector <char32_t> RandomChars(std::mt19937_64 &rng) {
+	std::vector <char32_t> chars(rng() % 300);
+	const bool dense = rng() % 2;
+	char32_t next = dense ? rng() % 0x800 : 0;
+	for (char32_t &chr : chars) {
+		chr = dense ? next++ : (char32_t)(rng() % 0x110000);
+		if (dense && rng() % 4 == 0) next += rng() % 8;
+	}
+	std::ranges::sort(chars);
+	chars.erase(std::ranges::unique(chars).begin(), chars.end());
+	return chars;
+}
+
+class Checker {
+	std::mt19937_64 rng_ {0x5EED};
+	size_t mismatches_ = 0;
+
+	void Report(const char *kernel, const SimdLevel level, const std::string_view input) {
+		if (mismatches_++ >= kMaxReports) return;
+		std::cerr << kernel << " at " << GetSimdName(level) << " is wrong on " << input.size() << " bytes:";
+		for (const char chr : input.substr(0, 80)) {
+			std::cerr << ' ' << std::hex << (int)(unsigned char)chr;
+		}
+		std::cerr << std::dec << std::endl;
+	}
+
+public:
+	[[nodiscard]] size_t GetMismatches() const { return mismatches_; }
+
+	void Fold(const SimdLevel level) {
+		std::string text = RandomText(rng_, rng_() % 400);
+		if (rng_() % 2) Corrupt(rng_, text);
+		// Unaligned starts, so loads split cache lines in every way
+		const size_t skip = std::min((size_t)(rng_() % 64), text.size());
+		const std::string_view in = std::string_view(text).substr(skip);
+		std::string expected(in.size(), '\0');
+		std::string out(in.size(), '\0');
+		FoldCase(in.data(), in.size(), expected.data(), SCALAR);
+		FoldCase(in.data(), in.size(), out.data(), level);
+		if (out != expected) Report("FoldCase", level, in);
+		// In place, as the tokenizer does
+		std::string folded(in);
+		FoldCase(folded.data(), folded.size(), folded.data(), level);
+		if (folded != expected) Report("FoldCase in place", level, in);
+	}
+
+	void Find(const SimdLevel level) {
+		const std::vector <char32_t> chars = RandomChars(rng_);
+		for (int i = 0; i < 16; i++) {
+			char32_t chr = rng_() % 0x110000;
+			if (!chars.empty() && rng_() % 2) chr = chars[rng_() % chars.size()] + (char32_t)(rng_() % 3) - 1;
+			const size_t expected = std::ranges::lower_bound(chars, chr) - chars.begin();
+			if (annealing::Trie::CountLess(chars.data(), chars.size(), chr, level) != expected) {
+				Report("Trie::CountLess", level, {(const char *)&chr, sizeof chr});
+				return;
+			}
+		}
+	}
+
+	void Decode(const SimdLevel level) {
+		const std::string text = RandomText(rng_, rng_() % 400);
+		// Skipping a complete prefix keeps the text valid
+		const size_t skip = CompletePrefix(text.data(), std::min((size_t)(rng_() % 64), text.size()));
+		const std::string_view in = std::string_view(text).substr(skip);
+		std::vector <char32_t> expected;
+		utf8::unchecked::utf8to32(in.begin(), in.end(), std::back_inserter(expected));
+		if (annealing::DecodeUtf8(in, level) != expected) Report("DecodeUtf8", level, in);
+	}
+};
+
+bool CheckSimdKernels(const size_t rounds) {
+	Checker checker;
+	for (int level = SCALAR; level <= GetSimdLevel(); level++) {
+		const size_t before = checker.GetMismatches();
+		for (size_t round = 0; round < rounds; round++) {
+			checker.Fold((SimdLevel)level);
+			checker.Find((SimdLevel)level);
+			checker.Decode((SimdLevel)level);
+		}
+		const size_t found = checker.GetMismatches() - before;
+		std::cout << GetSimdName((SimdLevel)level) << ": " << found << " mismatches on " << rounds
+			<< " inputs per kernel" << std::endl;
+	}
+	return checker.GetMismatches() == 0;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Runs every vector kernel (case folding, trie child search and UTF-8 decoding) at each SIMD level the CPU allows,
+ * up to the TOKENIZER_SIMD cap, and compares its output with the scalar kernel, or a plain reference where there is
+ * one (std::lower_bound, utf8cpp), on random inputs. The texts mix ASCII runs of every length with multi-byte
+ * sequences, so sequences straddle register boundaries of every width.
+ * Mismatches are printed to std::cerr.
+ * @param rounds Random inputs per kernel and level
+ * @return True if every kernel matched
+ */
+bool CheckSimdKernels(size_t rounds = 20000);
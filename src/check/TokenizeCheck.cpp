@@ -0,0 +1,143 @@
+#include "TokenizeCheck.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "../encoder/CaseFold.h"
+#include "../encoder/StreamTokenizer.h"
+#include "../files/SolutionFile.h"
+#include "../utils/Multithread.h"
+
+// The corpus is joined into documents at least this long for TokenizeParallel, so it cuts them on any pool
+constexpr size_t kParallelBytes = 16 << 20;
+// Joined documents checked, each trimmed at a different offset on both ends
+constexpr size_t kParallelRuns = 8;
+constexpr size_t kMaxTrim = 1 << 20;
+// Chunks fed to StreamTokenizer are up to this long, and half of them at most kSmallChunk
+constexpr size_t kMaxChunk = 4096;
+constexpr size_t kSmallChunk = 8;
+// Small enough for the corpus to keep evicting words
+constexpr size_t kWordCacheSize = 1 << 12;
+// Mismatches printed, the rest are only counted
+constexpr size_t kMaxReports = 5;
+
+using Ids = std::vector <uint32_t>;
+
+// Greedy tokenization the way it was first written: at each position every length from the longest token down is
+// looked up, and a byte nothing matches is unknown
+Ids ReferenceTokenize(const SolutionFile &tkn, const std::string_view input) {
+	std::string folded(input.size(), '\0');
+	FoldCase(input.data(), input.size(), folded.data());
+	const std::string_view text = folded;
+	Ids ids = {SolutionFile::kStartId};
+	for (size_t pos = 0; pos < text.size(); ) {
+		size_t len = std::min(std::max(tkn.GetMaxLen(), (size_t)1), text.size() - pos);
+		size_t id = tkn.GetId(text.substr(pos, len));
+		while (id == (size_t)-1 && len > 1) {
+			id = tkn.GetId(text.substr(pos, --len));
+		}
+		ids.push_back(id == (size_t)-1 ? SolutionFile::kUnknownId : (uint32_t)id);
+		pos += len;
+	}
+	ids.push_back(SolutionFile::kEndId);
+	return ids;
+}
+
+class PathChecker {
+	std::mt19937_64 rng_ {0x5EED};
+	size_t mismatches_ = 0;
+
+public:
+	[[nodiscard]] size_t GetMismatches() const { return mismatches_; }
+	[[nodiscard]] std::mt19937_64 &GetRng() { return rng_; }
+
+	void Compare(const char *path, const size_t doc, const Ids &expected, const Ids &ids) {
+		if (ids == expected || mismatches_++ >= kMaxReports) return;
+		const size_t at = std::ranges::mismatch(expected, ids).in1 - expected.begin();
+		std::cerr << path << " differs from Tokenize on document " << doc << ", first at id " << at << " of "
+			<< expected.size() << std::endl;
+	}
+
+	// Runs one path and prints how many of its documents differed
+	template <class F>
+	void Run(const char *path, const size_t doc_cnt, F &&check) {
+		const size_t before = mismatches_;
+		check();
+		std::cout << path << ": " << mismatches_ - before << " mismatches in " << doc_cnt << " documents" << std::endl;
+	}
+};
+
+bool CheckTokenize(SolutionFile &tkn, const std::vector <std::string_view> &docs, ThreadPool &pool) {
+	if (docs.empty()) {
+		std::cerr << "No documents to check against" << std::endl;
+		return false;
+	}
+	PathChecker checker;
+	tkn.DisableWordCache();
+	std::vector <Ids> expected(docs.size());
+	for (size_t doc = 0; doc < docs.size(); doc++) {
+		tkn.Tokenize(docs[doc], expected[doc]);
+	}
+
+	checker.Run("MatchTrie", docs.size(), [&] {
+		for (size_t doc = 0; doc < docs.size(); doc++) {
+			checker.Compare("MatchTrie", doc, ReferenceTokenize(tkn, docs[doc]), expected[doc]);
+		}
+	});
+
+	checker.Run("Word cache", 2 * docs.size(), [&] {
+		tkn.EnableWordCache(kWordCacheSize);
+		Ids ids;
+		// The second pass finds the words the first one cached, where they weren't evicted since
+		for (int pass = 0; pass < 2; pass++) {
+			for (size_t doc = 0; doc < docs.size(); doc++) {
+				tkn.Tokenize(docs[doc], ids);
+				checker.Compare("Word cache", doc, expected[doc], ids);
+			}
+		}
+		tkn.DisableWordCache();
+	});
+
+	checker.Run("StreamTokenizer", docs.size(), [&] {
+		std::mt19937_64 &rng = checker.GetRng();
+		StreamTokenizer stream(tkn);
+		Ids ids;
+		for (size_t doc = 0; doc < docs.size(); doc++) {
+			ids.clear();
+			for (size_t pos = 0; pos < docs[doc].size(); ) {
+				const size_t chunk = 1 + rng() % (rng() % 2 ? kSmallChunk : kMaxChunk);
+				stream.Feed(docs[doc].substr(pos, chunk), ids);
+				pos += chunk;
+			}
+			stream.Finish(ids);
+			checker.Compare("StreamTokenizer", doc, expected[doc], ids);
+		}
+	});
+
+	checker.Run("TokenizeParallel", kParallelRuns, [&] {
+		std::mt19937_64 &rng = checker.GetRng();
+		std::string joined;
+		while (joined.size() < kParallelBytes + 2 * kMaxTrim) {
+			for (const std::string_view doc : docs) {
+				joined += doc;
+				joined += '\n';
+			}
+		}
+		Ids ids;
+		Ids sequential;
+		for (size_t run = 0; run < kParallelRuns; run++) {
+			// Trimmed on code point boundaries, so the cuts fall at other places of the text in each run
+			const size_t begin = CodePointStart(joined.data(), rng() % kMaxTrim);
+			const size_t end = CompletePrefix(joined.data(), joined.size() - rng() % kMaxTrim);
+			const std::string_view input = std::string_view(joined).substr(begin, end - begin);
+			tkn.Tokenize(input, sequential);
+			tkn.TokenizeParallel(input, ids, pool);
+			checker.Compare("TokenizeParallel", run, sequential, ids);
+		}
+	});
+
+	return checker.GetMismatches() == 0;
+}
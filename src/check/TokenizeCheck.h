@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+class SolutionFile;
+class ThreadPool;
+
+/**
+ * Differential check of the greedy tokenization paths whose only correct result is the ids of sequential Tokenize:
+ * - the MatchTrie matcher, against the original one that tries every length from the longest token down
+ * - the word cache, small enough to evict, against uncached segmentation
+ * - StreamTokenizer, fed chunks of random sizes that also split UTF-8 sequences
+ * - TokenizeParallel, on the corpus joined into documents large enough to be cut, from varied offsets so cuts and
+ *   stitching land everywhere
+ * Mismatches are printed to std::cerr.
+ * @param tkn Its word cache is enabled during the check and disabled after it
+ * @param docs A sample corpus
+ * @return True if every path gave the same ids
+ */
+bool CheckTokenize(SolutionFile &tkn, const std::vector <std::string_view> &docs, ThreadPool &pool);
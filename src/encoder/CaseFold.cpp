@@ -0,0 +1,214 @@
+#include "CaseFold.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "../utils/CpuFeatures.h"
+
+// Lowercase of every code point with a 2 byte encoding, identity where there is none of the same length
+constexpr std::array <uint16_t, 0x800> kLower2 = [] {
+	std::array <uint16_t, 0x800> lower {};
+	for (uint16_t cp = 0; cp < lower.size(); ++cp) lower[cp] = cp;
+	const auto shift = [&lower](const uint16_t from, const uint16_t to, const uint16_t delta) {
+		for (uint16_t cp = from; cp <= to; ++cp) lower[cp] = cp + delta;
+	};
+	// Alternating upper/lower pairs starting at from
+	const auto pairs = [&lower](const uint16_t from, const uint16_t to) {
+		for (uint16_t cp = from; cp < to; cp += 2) lower[cp] = cp + 1;
+	};
+
+	shift(0xC0, 0xDE, 0x20);
+	lower[0xD7] = 0xD7; // multiplication sign
+	pairs(0x100, 0x12F);
+	pairs(0x132, 0x137);
+	pairs(0x139, 0x148);
+	pairs(0x14A, 0x177);
+	lower[0x178] = 0xFF;
+	pairs(0x179, 0x17E);
+	for (const uint16_t cp : {0x1C4, 0x1C7, 0x1CA, 0x1F1}) lower[cp] = cp + 2;
+	pairs(0x1CD, 0x1DC);
+	pairs(0x1DE, 0x1EF);
+	pairs(0x1F8, 0x21F);
+	pairs(0x222, 0x233);
+
+	lower[0x386] = 0x3AC;
+	shift(0x388, 0x38A, 0x25);
+	lower[0x38C] = 0x3CC;
+	shift(0x38E, 0x38F, 0x3F);
+	shift(0x391, 0x3A1, 0x20);
+	shift(0x3A3, 0x3AB, 0x20);
+	pairs(0x3D8, 0x3EF);
+
+	shift(0x400, 0x40F, 0x50);
+	shift(0x410, 0x42F, 0x20);
+	pairs(0x460, 0x481);
+	pairs(0x48A, 0x4BF);
+	lower[0x4C0] = 0x4CF;
+	pairs(0x4C1, 0x4CE);
+	pairs(0x4D0, 0x52F);
+
+	shift(0x531, 0x556, 0x30);
+	return lower;
+}();
+
+char32_t Lower3(const char32_t cp) {
+	if (cp >= 0x1E00 && cp <= 0x1E95) return cp | 1;
+	if (cp >= 0x1EA0 && cp <= 0x1EFF) return cp | 1;
+	if (cp >= 0x10A0 && cp <= 0x10C5) return cp - 0x10A0 + 0x2D00;
+	if (cp >= 0x24B6 && cp <= 0x24CF) return cp + 26;
+	if (cp >= 0x2C00 && cp <= 0x2C2F) return cp + 0x30;
+	if (cp >= 0x2C80 && cp <= 0x2CE3) return cp | 1;
+	if (cp >= 0xA640 && cp <= 0xA66D) return cp | 1;
+	if (cp >= 0xA680 && cp <= 0xA69B) return cp | 1;
+	if (cp >= 0xFF21 && cp <= 0xFF3A) return cp + 0x20;
+	return cp;
+}
+
+bool IsContinuation(const unsigned char byte) {
+	return (byte & 0xC0) == 0x80;
+}
+
+// Folds the code point starting at in, returning its length in bytes
+size_t FoldCodePoint(const char *in, const size_t avail, char *out) {
+	const auto *bytes = (const unsigned char *)in;
+	const unsigned char lead = bytes[0];
+	if (lead < 0x80) {
+		out[0] = (char)(lead | ((unsigned char)(lead - 'A') < 26 ? 0x20 : 0));
+		return 1;
+	}
+	if ((lead & 0xE0) == 0xC0 && avail >= 2 && IsContinuation(bytes[1])) {
+		const uint16_t cp = kLower2[(lead & 0x1F) << 6 | (bytes[1] & 0x3F)];
+		out[0] = (char)(0xC0 | cp >> 6);
+		out[1] = (char)(0x80 | (cp & 0x3F));
+		return 2;
+	}
+	if ((lead & 0xF0) == 0xE0 && avail >= 3 && IsContinuation(bytes[1]) && IsContinuation(bytes[2])) {
+		const char32_t cp = Lower3((lead & 0x0F) << 12 | (bytes[1] & 0x3F) << 6 | (bytes[2] & 0x3F));
+		out[0] = (char)(0xE0 | cp >> 12);
+		out[1] = (char)(0x80 | (cp >> 6 & 0x3F));
+		out[2] = (char)(0x80 | (cp & 0x3F));
+		return 3;
+	}
+	out[0] = in[0];
+	return 1;
+}
+
+// Each kernel folds the ASCII letters of a whole register per pass, from pos for as long as one fits, and returns where
+// it stopped. Bytes of multi-byte sequences are negative as signed chars and never match the range compare, so they
+// are then fixed one code point at a time.
+using FoldKernel = size_t (*)(const char *in, size_t size, char *out, size_t pos);
+
+// Folds 8 bytes at a time in a general purpose register. No byte is above 0x7F, so adding to one never carries
+// into the next, and the sign bits of the two sums tell which bytes are at least 'A' and which are above 'Z'.
+size_t FoldScalar(const char *in, const size_t size, char *out, size_t pos) {
+	constexpr uint64_t kBytes = 0x0101010101010101;
+	while (pos + 8 <= size) {
+		uint64_t text;
+		memcpy(&text, in + pos, 8);
+		if (text & kBytes * 0x80) {
+			pos += FoldCodePoint(in + pos, size - pos, out + pos);
+			continue;
+		}
+		const uint64_t upper = (text + kBytes * (0x80 - 'A')) & ~(text + kBytes * (0x7F - 'Z')) & kBytes * 0x80;
+		text |= upper >> 2;
+		memcpy(out + pos, &text, 8);
+		pos += 8;
+	}
+	return pos;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+size_t FoldSse2(const char *in, const size_t size, char *out, size_t pos) {
+	const __m128i upper_a = _mm_set1_epi8('A' - 1);
+	const __m128i upper_z = _mm_set1_epi8('Z' + 1);
+	const __m128i case_bit = _mm_set1_epi8(0x20);
+	while (pos + 16 <= size) {
+		const __m128i text = _mm_loadu_si128((const __m128i *)(in + pos));
+		const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(text, upper_a), _mm_cmplt_epi8(text, upper_z));
+		_mm_storeu_si128((__m128i *)(out + pos), _mm_or_si128(text, _mm_and_si128(upper, case_bit)));
+		const uint32_t wide = _mm_movemask_epi8(text);
+		if (wide == 0) {
+			pos += 16;
+			continue;
+		}
+		pos += __builtin_ctz(wide);
+		pos += FoldCodePoint(in + pos, size - pos, out + pos);
+	}
+	return pos;
+}
+
+__attribute__((target("avx2")))
+size_t FoldAvx2(const char *in, const size_t size, char *out, size_t pos) {
+	const __m256i upper_a = _mm256_set1_epi8('A' - 1);
+	const __m256i upper_z = _mm256_set1_epi8('Z' + 1);
+	const __m256i case_bit = _mm256_set1_epi8(0x20);
+	while (pos + 32 <= size) {
+		const __m256i text = _mm256_loadu_si256((const __m256i *)(in + pos));
+		const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(text, upper_a), _mm256_cmpgt_epi8(upper_z, text));
+		_mm256_storeu_si256((__m256i *)(out + pos), _mm256_or_si256(text, _mm256_and_si256(upper, case_bit)));
+		const uint32_t wide = _mm256_movemask_epi8(text);
+		if (wide == 0) {
+			pos += 32;
+			continue;
+		}
+		pos += __builtin_ctz(wide);
+		pos += FoldCodePoint(in + pos, size - pos, out + pos);
+	}
+	return FoldSse2(in, size, out, pos);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+size_t FoldAvx512(const char *in, const size_t size, char *out, size_t pos) {
+	const __m512i upper_a = _mm512_set1_epi8('A' - 1);
+	const __m512i upper_z = _mm512_set1_epi8('Z' + 1);
+	const __m512i case_bit = _mm512_set1_epi8(0x20);
+	while (pos + 64 <= size) {
+		const __m512i text = _mm512_loadu_si512(in + pos);
+		const __mmask64 upper = _mm512_cmpgt_epi8_mask(text, upper_a) & _mm512_cmplt_epi8_mask(text, upper_z);
+		_mm512_storeu_si512(out + pos, _mm512_mask_add_epi8(text, upper, text, case_bit));
+		const uint64_t wide = _mm512_movepi8_mask(text);
+		if (wide == 0) {
+			pos += 64;
+			continue;
+		}
+		pos += __builtin_ctzll(wide);
+		pos += FoldCodePoint(in + pos, size - pos, out + pos);
+	}
+	return FoldAvx2(in, size, out, pos);
+}
+#endif
+
+FoldKernel SelectFoldKernel(const SimdLevel level) {
+#if defined(__x86_64__) || defined(__i386__)
+	switch (std::min(level, GetSimdLevel())) {
+	case AVX512: return FoldAvx512;
+	case AVX2: return FoldAvx2;
+	case SSE2: return FoldSse2;
+	case SCALAR: break;
+	}
+#endif
+	return FoldScalar;
+}
+
+void FoldWith(const FoldKernel kernel, const char *in, const size_t size, char *out) {
+	size_t pos = kernel(in, size, out, 0);
+	while (pos < size) {
+		pos += FoldCodePoint(in + pos, size - pos, out + pos);
+	}
+}
+
+void FoldCase(const char *in, const size_t size, char *out) {
+	static const FoldKernel kernel = SelectFoldKernel(GetSimdLevel());
+	FoldWith(kernel, in, size, out);
+}
+
+void FoldCase(const char *in, const size_t size, char *out, const SimdLevel level) {
+	FoldWith(SelectFoldKernel(level), in, size, out);
+}
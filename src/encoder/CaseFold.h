@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+
+#include "../utils/CpuFeatures.h"
+
+/**
+ * Lowercases UTF-8 text without changing its length, so byte positions in the result are valid in the original.
+ * ASCII letters are folded a whole SIMD register at a time. Other letters go through a table of simple lowercase
+ * mappings, limited to those whose lowercase encodes in as many bytes (Latin, Greek, Cyrillic, Armenian...).
+ * Invalid or truncated sequences are copied unchanged.
+ * @param out Receives size bytes. May be the same as in.
+ */
+void FoldCase(const char *in, size_t size, char *out);
+/**
+ * Same as above with the kernel of a given level rather than the best one, to check kernels against each other.
+ * Levels above GetSimdLevel use its kernel.
+ */
+void FoldCase(const char *in, size_t size, char *out, SimdLevel level);
+
+/**
+ * @return The position of the first byte of the code point pos is in, at most 3 bytes back
+ */
+inline size_t CodePointStart(const char *text, size_t pos) {
+	for (size_t back = 0; back < 3 && pos > 0 && ((unsigned char)text[pos] & 0xC0) == 0x80; ++back) --pos;
+	return pos;
+}
+
+/**
+ * @return The length of text without a multi-byte sequence cut short at its end
+ */
+inline size_t CompletePrefix(const char *text, const size_t size) {
+	if (size == 0) return 0;
+	const size_t start = CodePointStart(text, size - 1);
+	const auto lead = (unsigned char)text[start];
+	const size_t len = (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : (lead & 0xF8) == 0xF0 ? 4 : 1;
+	return start + len > size ? start : size;
+}
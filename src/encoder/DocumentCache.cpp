@@ -0,0 +1,78 @@
+#include "DocumentCache.h"
+
+#include <algorithm>
+#include <limits>
+
+DocumentCache::DocumentCache(const size_t max_bytes) :
+	shards_(1 << kShardBits), shard_bytes_(max_bytes >> kShardBits) {}
+
+template <TokenId Id>
+bool DocumentCache::Lookup(const Hash128 &key, const std::span <Id> out, size_t &cnt) {
+	Shard &shard = GetShard(key);
+	std::lock_guard lock(shard.mutex);
+	const auto it = shard.index.find(key);
+	if (it == shard.index.end()) {
+		shard.misses++;
+		return false;
+	}
+	shard.hits++;
+	shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+	const std::vector <uint32_t> &ids = it->second->ids;
+	cnt = ids.size();
+	// Narrowing turns the 32 bit unknown id into the narrow one, like Tokenize does
+	std::transform(ids.begin(), ids.begin() + std::min(cnt, out.size()), out.begin(),
+	               [](const uint32_t id) { return (Id)id; });
+	return true;
+}
+template bool DocumentCache::Lookup(const Hash128 &, std::span <uint16_t>, size_t &);
+template bool DocumentCache::Lookup(const Hash128 &, std::span <uint32_t>, size_t &);
+
+template <TokenId Id>
+void DocumentCache::Insert(const Hash128 &key, const std::span <const Id> ids) {
+	const size_t bytes = kEntryOverhead + sizeof(uint32_t) * ids.size();
+	if (bytes > shard_bytes_) return;
+	Shard &shard = GetShard(key);
+	std::lock_guard lock(shard.mutex);
+	// Another thread may have missed on the same document at the same time
+	if (shard.index.contains(key)) return;
+
+	while (shard.bytes + bytes > shard_bytes_) {
+		const Entry &victim = shard.lru.back();
+		shard.bytes -= kEntryOverhead + sizeof(uint32_t) * victim.ids.size();
+		shard.index.erase(victim.key);
+		shard.lru.pop_back();
+		shard.evictions++;
+	}
+	Entry &entry = shard.lru.emplace_front();
+	entry.key = key;
+	entry.ids.reserve(ids.size());
+	for (const Id id : ids) {
+		entry.ids.push_back(id == std::numeric_limits <Id>::max() ? std::numeric_limits <uint32_t>::max() : id);
+	}
+	shard.index.emplace(key, shard.lru.begin());
+	shard.bytes += bytes;
+}
+template void DocumentCache::Insert(const Hash128 &, std::span <const uint16_t>);
+template void DocumentCache::Insert(const Hash128 &, std::span <const uint32_t>);
+
+DocumentCache::Stats DocumentCache::GetStats() {
+	Stats stats;
+	for (Shard &shard : shards_) {
+		std::lock_guard lock(shard.mutex);
+		stats.hits += shard.hits;
+		stats.misses += shard.misses;
+		stats.evictions += shard.evictions;
+		stats.entries += shard.index.size();
+		stats.bytes += shard.bytes;
+	}
+	return stats;
+}
+
+void DocumentCache::Clear() {
+	for (Shard &shard : shards_) {
+		std::lock_guard lock(shard.mutex);
+		shard.index.clear();
+		shard.lru.clear();
+		shard.bytes = 0;
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Segmenter.h"
+#include "TokenId.h"
+#include "../utils/Hash.h"
+
+/**
+ * Memory-capped LRU map from whole documents to their ids, for traffic with many exact duplicates.
+ * Documents are keyed by a 128 bit hash of their bytes and the segmentation mode, so a hit costs one pass of hashing.
+ * The cap is split over shards with a lock each. Ids are kept 32 bit wide and narrowed when copied out.
+ */
+class DocumentCache {
+public:
+	struct Stats {
+		size_t hits = 0;
+		size_t misses = 0;
+		size_t evictions = 0;
+		size_t entries = 0;
+		size_t bytes = 0;
+	};
+
+private:
+	static constexpr size_t kShardBits = 4;
+	// Bookkeeping of an entry besides its ids: list and map nodes, roughly
+	static constexpr size_t kEntryOverhead = 96;
+
+	struct Entry {
+		Hash128 key;
+		std::vector <uint32_t> ids;
+	};
+	struct KeyHash {
+		size_t operator()(const Hash128 &key) const { return key.low; }
+	};
+	struct alignas(64) Shard {
+		std::mutex mutex;
+		std::list <Entry> lru; // most recently used first
+		std::unordered_map <Hash128, std::list <Entry>::iterator, KeyHash> index;
+		size_t bytes = 0;
+		size_t hits = 0;
+		size_t misses = 0;
+		size_t evictions = 0;
+	};
+
+	std::vector <Shard> shards_;
+	size_t shard_bytes_;
+	std::atomic <bool> bypass_ = false;
+
+	Shard &GetShard(const Hash128 &key) { return shards_[key.high >> (64 - kShardBits)]; }
+
+public:
+	/**
+	 * @param max_bytes Memory the cached ids may take, bookkeeping included
+	 */
+	explicit DocumentCache(size_t max_bytes);
+
+	[[nodiscard]] static Hash128 Key(const std::string_view text, const Segmentation mode) {
+		return MurmurHash3(text.data(), text.size(), mode);
+	}
+
+	/**
+	 * Copies the ids of a cached document into out, as many as fit
+	 * @param cnt Set to the number of ids of the document on a hit
+	 * @return Whether the document was cached
+	 */
+	template <TokenId Id>
+	bool Lookup(const Hash128 &key, std::span <Id> out, size_t &cnt);
+	/**
+	 * Adds the ids of a document, evicting the least recently used ones over the cap.
+	 * Documents whose ids alone would take more than a shard's share of the cap are skipped.
+	 */
+	template <TokenId Id>
+	void Insert(const Hash128 &key, std::span <const Id> ids);
+
+	/**
+	 * While bypassed, the cache is neither read nor filled, but keeps its contents
+	 */
+	void SetBypass(const bool bypass) { bypass_.store(bypass, std::memory_order_relaxed); }
+	[[nodiscard]] bool IsBypassed() const { return bypass_.load(std::memory_order_relaxed); }
+
+	[[nodiscard]] Stats GetStats();
+	void Clear();
+};
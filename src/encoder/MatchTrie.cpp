@@ -0,0 +1,117 @@
+#include "MatchTrie.h"
+
+#include <algorithm>
+
+class MatchTrie::Builder {
+	std::vector <Unit> units_;
+	// Doubly linked ring of free units. Unit 0 is the root and doubles as the head of the ring.
+	std::vector <uint32_t> free_next_ = {0};
+	std::vector <uint32_t> free_prev_ = {0};
+
+	void Grow(size_t size);
+	void Occupy(uint32_t pos, uint32_t parent);
+	uint32_t FindBase(const std::vector <uint8_t> &labels);
+	void BuildNode(uint32_t node, const std::vector <std::pair <std::string_view, uint32_t>> &keys,
+	               size_t begin, size_t end, size_t depth);
+
+public:
+	std::vector <Unit> Build(const std::vector <std::pair <std::string_view, uint32_t>> &keys);
+};
+
+void MatchTrie::Builder::Grow(const size_t size) {
+	const size_t old = units_.size();
+	units_.resize(size);
+	free_next_.resize(size);
+	free_prev_.resize(size);
+	for (size_t pos = std::max(old, (size_t)1); pos < size; ++pos) {
+		free_prev_[pos] = free_prev_[0];
+		free_next_[pos] = 0;
+		free_next_[free_prev_[0]] = pos;
+		free_prev_[0] = pos;
+	}
+}
+
+void MatchTrie::Builder::Occupy(const uint32_t pos, const uint32_t parent) {
+	units_[pos].check = parent;
+	free_next_[free_prev_[pos]] = free_next_[pos];
+	free_prev_[free_next_[pos]] = free_prev_[pos];
+}
+
+uint32_t MatchTrie::Builder::FindBase(const std::vector <uint8_t> &labels) {
+	for (uint32_t pos = free_next_[0]; ; pos = free_next_[pos]) {
+		if (pos == 0) {
+			// Ran out of free units, append a fresh block and continue from its start
+			pos = units_.size();
+			Grow(2 * units_.size() + kAlphabet);
+		}
+		if (pos <= labels[0]) continue;
+		const size_t base = pos - labels[0];
+		if (units_.size() < base + kAlphabet) Grow(2 * units_.size() + kAlphabet);
+		if (std::ranges::all_of(labels, [&](const uint8_t label) { return units_[base + label].check == kFree; })) {
+			return base;
+		}
+	}
+}
+
+void MatchTrie::Builder::BuildNode(const uint32_t node, const std::vector <std::pair <std::string_view, uint32_t>> &keys,
+                                   size_t begin, const size_t end, const size_t depth) {
+	if (begin < end && keys[begin].first.size() == depth) {
+		units_[node].id = keys[begin].second;
+		++begin;
+	}
+	if (begin == end) return;
+
+	std::vector <uint8_t> labels;
+	for (size_t i = begin; i < end; ++i) {
+		const uint8_t label = keys[i].first[depth];
+		if (labels.empty() || labels.back() != label) labels.push_back(label);
+	}
+	const uint32_t base = FindBase(labels);
+	units_[node].base = base;
+	for (const uint8_t label : labels) {
+		Occupy(base + label, node);
+	}
+
+	for (size_t from = begin; from < end;) {
+		const uint8_t label = keys[from].first[depth];
+		size_t to = from;
+		while (to < end && (uint8_t)keys[to].first[depth] == label) ++to;
+		BuildNode(base + label, keys, from, to, depth + 1);
+		from = to;
+	}
+}
+
+std::vector <MatchTrie::Unit> MatchTrie::Builder::Build(const std::vector <std::pair <std::string_view, uint32_t>> &keys) {
+	Grow(1 + kAlphabet);
+	BuildNode(0, keys, 0, keys.size(), 0);
+
+	uint32_t max_base = 0;
+	size_t used = 1;
+	for (size_t i = 0; i < units_.size(); ++i) {
+		max_base = std::max(max_base, units_[i].base);
+		if (units_[i].check != kFree) used = i + 1;
+	}
+	units_.resize(std::max(used, (size_t)max_base + kAlphabet));
+	units_.shrink_to_fit();
+	return std::move(units_);
+}
+
+std::vector <MatchTrie::Unit> MatchTrie::Build(std::vector <std::pair <std::string_view, uint32_t>> keys) {
+	std::erase_if(keys, [](const auto &key) { return key.first.empty(); });
+	std::ranges::sort(keys);
+	const auto dup = std::ranges::unique(keys, [](const auto &x, const auto &y) { return x.first == y.first; });
+	keys.erase(dup.begin(), dup.end());
+
+	return Builder().Build(keys);
+}
+
+bool MatchTrie::IsValid(const std::span <const Unit> units, const size_t id_cnt) {
+	if (units.size() < kAlphabet) return false;
+	// Transitions index base + byte without checks, and only compare check
+	const size_t max_base = units.size() - kAlphabet;
+	return std::ranges::all_of(units, [max_base, &units, id_cnt](const Unit &unit) {
+		return unit.base <= max_base &&
+		       (unit.check == kFree || unit.check < units.size()) &&
+		       (unit.id == kNoId || unit.id < id_cnt);
+	});
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * Double-array trie over the bytes of a fixed vocabulary, used for longest-match tokenization.
+ * The child of node s on byte c is unit base(s) + c, valid only if that unit's check is s.
+ * Text is matched byte for byte, so it must be case folded beforehand.
+ * The trie is a view: the units are owned by whoever compiled or mapped them.
+ */
+class MatchTrie {
+public:
+	static constexpr uint32_t kNoId = -1;
+
+	struct Unit {
+		uint32_t base = 0;
+		uint32_t check = kFree;
+		uint32_t id = kNoId;
+	};
+
+private:
+	static constexpr uint32_t kFree = -1;
+	// Slack kept past the largest base so transitions never need a bounds check
+	static constexpr size_t kAlphabet = 256;
+
+	class Builder;
+
+	const Unit *units_ = nullptr;
+	size_t max_len_ = 0;
+
+public:
+	MatchTrie() = default;
+	/**
+	 * @param max_len The length of the longest entry, which bounds how far any match looks ahead
+	 */
+	MatchTrie(const std::span <const Unit> units, const size_t max_len) : units_(units.data()), max_len_(max_len) {}
+
+	[[nodiscard]] size_t GetMaxLen() const { return max_len_; }
+
+	/**
+	 * Compiles the units of a trie from a list of (token, id) pairs
+	 * @param keys The tokens to match. If a token appears more than once, the smallest id is kept.
+	 * @return The units, to be kept alive for as long as any MatchTrie views them
+	 */
+	static std::vector <Unit> Build(std::vector <std::pair <std::string_view, uint32_t>> keys);
+	/**
+	 * Checks units read from outside, such as a mapped file, can be walked without going out of bounds
+	 * @param id_cnt Every id in the units must be below it
+	 */
+	[[nodiscard]] static bool IsValid(std::span <const Unit> units, size_t id_cnt);
+
+	/**
+	 * Finds the id of a vocabulary entry by exact match
+	 * @return The id of the entry, or kNoId if it isn't in the vocabulary
+	 */
+	[[nodiscard]] uint32_t Find(std::string_view token) const {
+		if (units_ == nullptr) return kNoId;
+		uint32_t node = 0;
+		for (const char chr : token) {
+			const uint32_t next = units_[node].base + (uint8_t)chr;
+			if (units_[next].check != node) return kNoId;
+			node = next;
+		}
+		return token.empty() ? kNoId : units_[node].id;
+	}
+
+	/**
+	 * @return How many bytes of [begin, end) the trie can follow, whether or not they end an entry.
+	 *		No entry matching at begin can be longer.
+	 */
+	[[nodiscard]] size_t PrefixDepth(const char *begin, const char *end) const {
+		if (units_ == nullptr) return 0;
+		uint32_t node = 0;
+		const char *it = begin;
+		for (; it != end; ++it) {
+			const uint32_t next = units_[node].base + (uint8_t)*it;
+			if (units_[next].check != node) break;
+			node = next;
+		}
+		return it - begin;
+	}
+
+	/**
+	 * Calls f(len, id) for every vocabulary entry that is a prefix of [begin, end), shortest first
+	 */
+	template <class F>
+	void ForEachPrefix(const char *begin, const char *end, F &&f) const {
+		const Unit *units = units_;
+		if (units == nullptr) return;
+		uint32_t node = 0;
+		for (const char *it = begin; it != end; ++it) {
+			const uint32_t next = units[node].base + (uint8_t)*it;
+			if (units[next].check != node) break;
+			node = next;
+			if (units[node].id != kNoId) f((size_t)(it - begin + 1), units[node].id);
+		}
+	}
+
+	/**
+	 * Finds the longest vocabulary entry that is a prefix of [begin, end)
+	 * @param id Set to the id of the match, or kNoId if there is none
+	 * @return The length of the match in bytes, 0 if there is none
+	 */
+	size_t LongestMatch(const char *begin, const char *end, uint32_t &id) const {
+		size_t len = 0;
+		id = kNoId;
+		ForEachPrefix(begin, end, [&len, &id](const size_t pref_len, const uint32_t pref_id) {
+			len = pref_len;
+			id = pref_id;
+		});
+		return len;
+	}
+};
@@ -0,0 +1,90 @@
+#include "PerfectHash.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+// Seeds are tried in order from this one until every bucket can be placed, which almost always happens at once
+constexpr uint64_t kFirstSeed = 0x746F6B656E697A65ULL;
+
+bool PerfectHash::TryBuild(const std::vector <uint64_t> &hashes, const std::vector <uint32_t> &ids, Table &table) {
+	const size_t bucket_cnt = table.displace.size();
+	const size_t slot_cnt = table.slots.size();
+	std::vector <size_t> bucket_begin(bucket_cnt + 1);
+	for (const uint64_t hash : hashes) {
+		bucket_begin[ReduceRange(hash, bucket_cnt) + 1]++;
+	}
+	std::partial_sum(bucket_begin.begin(), bucket_begin.end(), bucket_begin.begin());
+	std::vector <size_t> members(hashes.size());
+	{
+		std::vector <size_t> fill(bucket_begin.begin(), bucket_begin.end() - 1);
+		for (size_t key = 0; key < hashes.size(); key++) {
+			members[fill[ReduceRange(hashes[key], bucket_cnt)]++] = key;
+		}
+	}
+
+	// Largest buckets first, while most slots are still free
+	std::vector <size_t> order(bucket_cnt);
+	std::iota(order.begin(), order.end(), 0);
+	std::ranges::stable_sort(order, [&bucket_begin](const size_t x, const size_t y) {
+		return bucket_begin[x + 1] - bucket_begin[x] > bucket_begin[y + 1] - bucket_begin[y];
+	});
+
+	std::ranges::fill(table.slots, kNoId);
+	std::ranges::fill(table.displace, 0);
+	std::vector <size_t> placed;
+	for (const size_t bucket : order) {
+		const size_t begin = bucket_begin[bucket];
+		const size_t end = bucket_begin[bucket + 1];
+		if (begin == end) break;
+		bool done = false;
+		for (uint32_t displace = 0; displace <= std::numeric_limits <uint16_t>::max() && !done; displace++) {
+			placed.clear();
+			done = true;
+			for (size_t i = begin; i < end; i++) {
+				const size_t slot = Slot(hashes[members[i]], displace, slot_cnt);
+				if (table.slots[slot] != kNoId) {
+					done = false;
+					break;
+				}
+				table.slots[slot] = ids[members[i]];
+				placed.push_back(slot);
+			}
+			if (done) {
+				table.displace[bucket] = displace;
+				break;
+			}
+			for (const size_t slot : placed) {
+				table.slots[slot] = kNoId;
+			}
+		}
+		if (!done) return false;
+	}
+	return true;
+}
+
+PerfectHash::Table PerfectHash::Build(std::vector <std::pair <std::string_view, uint32_t>> keys) {
+	std::erase_if(keys, [](const auto &key) { return key.first.empty(); });
+	std::ranges::sort(keys);
+	const auto dup = std::ranges::unique(keys, [](const auto &x, const auto &y) { return x.first == y.first; });
+	keys.erase(dup.begin(), dup.end());
+	if (keys.empty()) return {};
+
+	Table table;
+	table.displace.resize(keys.size() / kBucketSize + 1);
+	table.slots.resize(keys.size() + keys.size() * kSpareSlots / 100 + 1);
+	std::vector <uint32_t> ids;
+	ids.reserve(keys.size());
+	for (const auto &key : keys) {
+		ids.push_back(key.second);
+	}
+	std::vector <uint64_t> hashes(keys.size());
+	for (table.seed = kFirstSeed; ; table.seed++) {
+		for (size_t key = 0; key < keys.size(); key++) {
+			hashes[key] = MurmurHash64A(keys[key].first.data(), keys[key].first.size(), table.seed);
+		}
+		if (TryBuild(hashes, ids, table)) return table;
+		// Each failure adds spare slots, so the search always ends
+		table.slots.resize(table.slots.size() + keys.size() * kSpareSlots / 100 + 1);
+	}
+}
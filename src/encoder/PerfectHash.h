@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../utils/Hash.h"
+
+/**
+ * Static perfect hash over a fixed set of keys, built by hash-and-displace (CHD).
+ * Keys are hashed into small buckets, and each bucket stores the displacement that sent all its keys to free slots.
+ * A lookup is one key hash and two array reads. Slots hold ids, not keys: a string that isn't a key still lands
+ * on some slot, so the caller compares the key bytes of the id it gets.
+ * Like MatchTrie, the hash is a view over tables owned elsewhere.
+ */
+class PerfectHash {
+public:
+	static constexpr uint32_t kNoId = -1;
+
+	struct Table {
+		uint64_t seed = 0;
+		std::vector <uint16_t> displace; // per bucket
+		std::vector <uint32_t> slots;    // id of the key in each slot, kNoId for the few spare ones
+	};
+
+private:
+	// Keys per bucket on average, and spare slots per 100 keys, which keep the last buckets quick to place
+	static constexpr size_t kBucketSize = 5;
+	static constexpr size_t kSpareSlots = 1;
+
+	uint64_t seed_ = 0;
+	const uint16_t *displace_ = nullptr;
+	size_t bucket_cnt_ = 0;
+	const uint32_t *slots_ = nullptr;
+	size_t slot_cnt_ = 0;
+
+	static size_t Slot(const uint64_t hash, const uint16_t displace, const size_t slot_cnt) {
+		return ReduceRange(Fmix64(hash + (displace + 1) * 0x9E3779B97F4A7C15ULL), slot_cnt);
+	}
+	static bool TryBuild(const std::vector <uint64_t> &hashes, const std::vector <uint32_t> &ids, Table &table);
+
+public:
+	PerfectHash() = default;
+	PerfectHash(const uint64_t seed, const std::span <const uint16_t> displace, const std::span <const uint32_t> slots) :
+		seed_(seed), displace_(displace.data()), bucket_cnt_(displace.size()),
+		slots_(slots.data()), slot_cnt_(slots.size()) {}
+
+	/**
+	 * Places a list of (key, id) pairs
+	 * @param keys The keys to index. If a key appears more than once, the smallest id is kept.
+	 * @return The tables, to be kept alive for as long as any PerfectHash views them
+	 */
+	static Table Build(std::vector <std::pair <std::string_view, uint32_t>> keys);
+
+	/**
+	 * @return The id in the slot key hashes to: the id of key if it is one of the keys, otherwise any id or kNoId
+	 */
+	[[nodiscard]] uint32_t Lookup(const std::string_view key) const {
+		if (slot_cnt_ == 0) return kNoId;
+		const uint64_t hash = MurmurHash64A(key.data(), key.size(), seed_);
+		return slots_[Slot(hash, displace_[ReduceRange(hash, bucket_cnt_)], slot_cnt_)];
+	}
+};
@@ -0,0 +1,39 @@
+#include "Segmenter.h"
+
+void FillOptimal(const MatchTrie &matcher, const std::string_view text, SegmentScratch &scratch) {
+	const size_t size = text.size();
+	scratch.cost.resize(size + 1);
+	scratch.id.resize(size + 1);
+	scratch.len.resize(size + 1);
+	scratch.cost[size] = 0;
+	for (size_t pos = size; pos-- > 0;) {
+		// Skipping one byte as unknown is always a candidate: it can reach a cheaper suffix even when a longer prefix
+		// matches, e.g. inside a UTF-8 sequence. Matches replace it on a tie, so a token is preferred over an unknown.
+		uint32_t best_cost = scratch.cost[pos + 1] + 1;
+		uint32_t best_id = MatchTrie::kNoId;
+		size_t best_len = 1;
+		matcher.ForEachPrefix(text.data() + pos, text.data() + size, [&](const size_t len, const uint32_t id) {
+			const uint32_t cost = scratch.cost[pos + len] + 1;
+			if (cost > best_cost) return;
+			best_cost = cost;
+			best_id = id;
+			best_len = len;
+		});
+		scratch.cost[pos] = best_cost;
+		scratch.id[pos] = best_id;
+		scratch.len[pos] = best_len;
+	}
+}
+
+bool GreedyLoses(const MatchTrie &matcher, const char *pos, const char *end, const size_t len,
+                 const size_t next_len) {
+	const size_t greedy_reach = len + std::max(next_len, (size_t)1);
+	bool loses = false;
+	matcher.ForEachPrefix(pos, end, [&](const size_t pref_len, uint32_t) {
+		if (loses || pref_len == len || pos + pref_len == end) return;
+		uint32_t id;
+		const size_t reach = pref_len + std::max(matcher.LongestMatch(pos + pref_len, end, id), (size_t)1);
+		loses = reach > greedy_reach;
+	});
+	return loses;
+}
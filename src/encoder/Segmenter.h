@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "CaseFold.h"
+#include "MatchTrie.h"
+
+enum Segmentation {
+	GREEDY,  // longest match first, the fastest
+	OPTIMAL, // fewest tokens overall, by dynamic programming over the whole input
+	HYBRID   // greedy, redone by dynamic programming in short windows where a lookahead shows greedy loses tokens
+};
+
+/**
+ * Growable buffers for the dynamic programming modes, reusable between calls
+ */
+struct SegmentScratch {
+	std::string folded;
+	std::vector <uint32_t> cost; // fewest tokens covering the text from each position to its end
+	std::vector <uint32_t> id;   // first token of that covering
+	std::vector <uint16_t> len;
+};
+
+/**
+ * Solves the fewest-token segmentation of an already case folded text into scratch.
+ * Only matches that end inside text are used. A byte where none starts is a token of its own with id kNoId.
+ * Among equally short segmentations the one with longer tokens first is kept, the closest to greedy.
+ */
+void FillOptimal(const MatchTrie &matcher, std::string_view text, SegmentScratch &scratch);
+
+/**
+ * Whether some shorter match at pos reaches further in two tokens than the greedy match does, in folded text
+ * @param len The length of the greedy match at pos
+ * @param next_len The length of the greedy match right after it
+ */
+bool GreedyLoses(const MatchTrie &matcher, const char *pos, const char *end, size_t len, size_t next_len);
+
+/**
+ * Greedy longest-match segmentation. The text is case folded a window at a time into a stack buffer,
+ * so nothing is allocated unless the vocabulary has tokens longer than a quarter of the window.
+ * @param emit Called as emit(id, pos, len) for every token in order. Bytes no token starts with
+ *		are emitted one at a time with id kNoId.
+ */
+template <class Emit>
+void SegmentGreedy(const MatchTrie &matcher, const std::string_view text, Emit &&emit) {
+	constexpr size_t kWindow = 1 << 13;
+	const size_t max_len = matcher.GetMaxLen();
+	char stack[kWindow];
+	std::vector <char> heap;
+	char *window = stack;
+	size_t window_size = kWindow;
+	if (window_size < 4 * (max_len + 4)) {
+		heap.resize(4 * (max_len + 4));
+		window = heap.data();
+		window_size = heap.size();
+	}
+
+	size_t pos = 0;
+	while (pos < text.size()) {
+		// Windows start and end on code point boundaries, so every sequence is folded whole
+		const size_t from = CodePointStart(text.data(), pos);
+		size_t to = std::min(text.size(), from + window_size);
+		if (to < text.size()) to = CodePointStart(text.data(), to);
+		FoldCase(text.data() + from, to - from, window);
+		// Tokens starting before commit have all the bytes they could match inside the window
+		const size_t commit = to == text.size() ? to : to - max_len;
+		const char *end = window + (to - from);
+		do {
+			uint32_t id;
+			const size_t len = std::max(matcher.LongestMatch(window + (pos - from), end, id), (size_t)1);
+			emit(id, pos, len);
+			pos += len;
+		} while (pos < commit);
+	}
+}
+
+/**
+ * Segments a text with the given mode, folding its case first
+ * @param emit Called as emit(id, pos, len) for every token in order, like SegmentGreedy
+ */
+template <class Emit>
+void Segment(const MatchTrie &matcher, const std::string_view text, const Segmentation mode,
+             SegmentScratch &scratch, Emit &&emit) {
+	// Minimum size of a repaired window in hybrid mode. It always ends on a greedy token boundary.
+	constexpr size_t kHybridWindow = 64;
+
+	if (mode == GREEDY) {
+		SegmentGreedy(matcher, text, emit);
+		return;
+	}
+	scratch.folded.resize(text.size());
+	FoldCase(text.data(), text.size(), scratch.folded.data());
+
+	const auto emit_optimal = [&scratch, &emit](const size_t offset, const size_t size) {
+		for (size_t pos = 0; pos < size; pos += scratch.len[pos]) {
+			emit(scratch.id[pos], offset + pos, (size_t)scratch.len[pos]);
+		}
+	};
+	if (mode == OPTIMAL) {
+		FillOptimal(matcher, scratch.folded, scratch);
+		emit_optimal(0, text.size());
+		return;
+	}
+
+	const char *begin = scratch.folded.data();
+	const char *end = begin + text.size();
+	const char *pos = begin;
+	uint32_t id;
+	size_t len = matcher.LongestMatch(pos, end, id);
+	while (pos != end) {
+		uint32_t next_id = MatchTrie::kNoId;
+		const size_t next_len = pos + std::max(len, (size_t)1) == end ? 0 :
+			matcher.LongestMatch(pos + std::max(len, (size_t)1), end, next_id);
+		if (len == 0 || !GreedyLoses(matcher, pos, end, len, next_len)) {
+			emit(id, (size_t)(pos - begin), std::max(len, (size_t)1));
+			pos += std::max(len, (size_t)1);
+			id = next_id;
+			len = next_len;
+			continue;
+		}
+
+		const char *window_end = pos + len;
+		while (window_end != end && window_end < pos + kHybridWindow) {
+			uint32_t skip;
+			window_end += std::max(matcher.LongestMatch(window_end, end, skip), (size_t)1);
+		}
+		FillOptimal(matcher, {pos, (size_t)(window_end - pos)}, scratch);
+		emit_optimal(pos - begin, window_end - pos);
+		pos = window_end;
+		len = matcher.LongestMatch(pos, end, id);
+	}
+}
@@ -0,0 +1,75 @@
+#include "StreamTokenizer.h"
+
+#include <algorithm>
+
+#include "CaseFold.h"
+#include "../files/SolutionFile.h"
+
+StreamTokenizer::StreamTokenizer(const SolutionFile &vocab) :
+	vocab_(vocab) {
+	carry_.reserve(2 * vocab_.GetMaxLen());
+}
+
+// Emits tokens starting before stop, as long as enough bytes follow them for the match to be final
+template <TokenId Id>
+size_t StreamTokenizer::Advance(const std::string_view text, size_t pos, const size_t stop, const bool final,
+                                std::vector <Id> &out) const {
+	const MatchTrie &matcher = vocab_.GetMatcher();
+	const size_t max_len = vocab_.GetMaxLen();
+	const char *end = text.data() + text.size();
+	while (pos < stop && (final || text.size() - pos >= max_len)) {
+		uint32_t id;
+		const size_t len = matcher.LongestMatch(text.data() + pos, end, id);
+		out.push_back((Id)id);
+		pos += std::max(len, (size_t)1);
+	}
+	return pos;
+}
+
+template <TokenId Id>
+void StreamTokenizer::Feed(const std::string_view chunk, std::vector <Id> &out) {
+	if (!started_) {
+		out.push_back(SolutionFile::kStartId);
+		started_ = true;
+	}
+	folded_.assign(pending_);
+	folded_.append(chunk);
+	const size_t complete = CompletePrefix(folded_.data(), folded_.size());
+	pending_.assign(folded_, complete);
+	folded_.resize(complete);
+	FoldCase(folded_.data(), folded_.size(), folded_.data());
+	const std::string_view text = folded_;
+
+	size_t skip = 0;
+	if (!carry_.empty()) {
+		// Stitch the carried tail to the start of the chunk, just enough to finish the tokens starting in the tail
+		const size_t old_size = carry_.size();
+		carry_.append(text.substr(0, vocab_.GetMaxLen()));
+		const size_t pos = Advance(carry_, 0, old_size, false, out);
+		if (pos < old_size) {
+			// The whole chunk fit in the stitch and still didn't give enough lookahead
+			carry_.erase(0, pos);
+			return;
+		}
+		skip = pos - old_size;
+	}
+	const size_t pos = Advance(text, skip, text.size(), false, out);
+	carry_.assign(text.substr(pos));
+}
+template void StreamTokenizer::Feed(std::string_view, std::vector <uint16_t> &);
+template void StreamTokenizer::Feed(std::string_view, std::vector <uint32_t> &);
+
+template <TokenId Id>
+void StreamTokenizer::Finish(std::vector <Id> &out) {
+	if (!started_) out.push_back(SolutionFile::kStartId);
+	const size_t tail = carry_.size();
+	carry_.append(pending_);
+	FoldCase(carry_.data() + tail, pending_.size(), carry_.data() + tail);
+	Advance(carry_, 0, carry_.size(), true, out);
+	out.push_back(SolutionFile::kEndId);
+	pending_.clear();
+	carry_.clear();
+	started_ = false;
+}
+template void StreamTokenizer::Finish(std::vector <uint16_t> &);
+template void StreamTokenizer::Finish(std::vector <uint32_t> &);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TokenId.h"
+
+class SolutionFile;
+
+/**
+ * Greedy tokenizer for input that arrives in chunks of any size, e.g. from a pipe or a socket.
+ * Only the bytes whose tokens still depend on unseen input are held back, at most one less than the longest token,
+ * plus a UTF-8 sequence split by the end of a chunk, which waits to be case folded whole.
+ * The ids are exactly those SolutionFile::Tokenize gives for the concatenated input, in the same width.
+ */
+class StreamTokenizer {
+	const SolutionFile &vocab_;
+	std::string pending_; // raw bytes of a cut UTF-8 sequence
+	std::string folded_;  // the current chunk, case folded
+	std::string carry_;   // folded tail whose tokens aren't final yet
+	bool started_ = false;
+
+	template <TokenId Id>
+	size_t Advance(std::string_view text, size_t pos, size_t stop, bool final, std::vector <Id> &out) const;
+
+public:
+	explicit StreamTokenizer(const SolutionFile &vocab);
+
+	/**
+	 * Tokenizes the next chunk of the document
+	 * @param out Receives the ids that are now final, appended after its current contents.
+	 *		The first call also emits SolutionFile::kStartId.
+	 */
+	template <TokenId Id>
+	void Feed(std::string_view chunk, std::vector <Id> &out);
+	/**
+	 * Ends the document, emitting the ids of the carried bytes followed by SolutionFile::kEndId.
+	 * The tokenizer can then be reused for a new document.
+	 */
+	template <TokenId Id>
+	void Finish(std::vector <Id> &out);
+};
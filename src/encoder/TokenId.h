@@ -0,0 +1,15 @@
+#pragma once
+
+#include <concepts>
+#include <cstdint>
+
+/**
+ * Integer types token ids can be written as. The widest id value of each is reserved for unknown bytes.
+ */
+template <class Id>
+concept TokenId = std::same_as <Id, uint16_t> || std::same_as <Id, uint32_t>;
+
+enum IdWidth {
+	ID16,
+	ID32
+};
@@ -0,0 +1,106 @@
+#include "WordCache.h"
+
+// Every cache gets its own serial, so a thread's local copy is never mistaken for that of another vocabulary
+std::atomic <uint64_t> next_serial = 1;
+
+void WordCache::Local::Store(const std::string_view key, const size_t hash, const std::span <const uint32_t> ids,
+                             const std::span <const uint16_t> lens) {
+	if (key.size() > kMaxKey || ids.size() > kMaxTokens) return;
+	Slot &slot = slots[hash % kSlots];
+	slot.key_len = key.size();
+	memcpy(slot.key, key.data(), key.size());
+	slot.token_cnt = ids.size();
+	std::ranges::copy(ids, slot.ids);
+	std::ranges::copy(lens, slot.lens);
+}
+
+WordCache::WordCache(const size_t capacity) :
+	serial_(next_serial.fetch_add(1)), shards_(1 << kShardBits),
+	shard_capacity_(std::max(capacity >> kShardBits, (size_t)1)) {
+	for (Shard &shard : shards_) {
+		shard.entries.reserve(shard_capacity_);
+		shard.index.reserve(shard_capacity_);
+	}
+}
+
+WordCache::Local &WordCache::GetLocal() const {
+	thread_local Local local;
+	if (local.owner != serial_) {
+		for (Local::Slot &slot : local.slots) {
+			slot.key_len = 0;
+		}
+		local.owner = serial_;
+	}
+	return local;
+}
+
+WordCache::Shard &WordCache::GetShard(const size_t hash) {
+	// Top bits of a multiplicative remix, since the map of the shard uses the low bits
+	return shards_[(uint64_t)hash * 0x9E3779B97F4A7C15ULL >> (64 - kShardBits)];
+}
+
+WordCache::Result WordCache::Lookup(const std::string_view key, const size_t hash, std::vector <uint32_t> &ids,
+                                    std::vector <uint16_t> &lens) {
+	Shard &shard = GetShard(hash);
+	std::lock_guard lock(shard.mutex);
+	const auto it = shard.index.find(key);
+	if (it == shard.index.end()) return ABSENT;
+	Entry &entry = shard.entries[it->second];
+	entry.referenced = true;
+	if (!entry.cacheable) return UNCACHEABLE;
+	ids.assign(entry.ids.begin(), entry.ids.end());
+	lens.assign(entry.lens.begin(), entry.lens.end());
+	return FOUND;
+}
+
+void WordCache::Insert(const std::string_view key, const size_t hash, const std::span <const uint32_t> ids,
+                       const std::span <const uint16_t> lens) {
+	Shard &shard = GetShard(hash);
+	std::lock_guard lock(shard.mutex);
+	// Another thread may have missed on the same key at the same time
+	if (shard.index.contains(key)) return;
+
+	size_t pos;
+	if (shard.entries.size() < shard_capacity_) {
+		pos = shard.entries.size();
+		shard.entries.emplace_back();
+	}
+	else {
+		while (shard.entries[shard.hand].referenced) {
+			shard.entries[shard.hand].referenced = false;
+			shard.hand = (shard.hand + 1) % shard.entries.size();
+		}
+		pos = shard.hand;
+		shard.hand = (shard.hand + 1) % shard.entries.size();
+		shard.index.erase(shard.entries[pos].key);
+		shard.evictions++;
+	}
+	Entry &entry = shard.entries[pos];
+	entry.key.assign(key);
+	entry.cacheable = !ids.empty();
+	entry.referenced = false;
+	entry.ids.assign(ids.begin(), ids.end());
+	entry.lens.assign(lens.begin(), lens.end());
+	shard.index.emplace(entry.key, pos);
+}
+
+WordCache::Stats WordCache::GetStats() {
+	Stats stats;
+	stats.hits = hits_.load(std::memory_order_relaxed);
+	stats.misses = misses_.load(std::memory_order_relaxed);
+	for (Shard &shard : shards_) {
+		std::lock_guard lock(shard.mutex);
+		stats.evictions += shard.evictions;
+		stats.entries += shard.entries.size();
+	}
+	return stats;
+}
+
+void WordCache::Clear() {
+	for (Shard &shard : shards_) {
+		std::lock_guard lock(shard.mutex);
+		shard.index.clear();
+		shard.entries.clear();
+		shard.hand = 0;
+	}
+}
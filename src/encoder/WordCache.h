@@ -0,0 +1,212 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "CaseFold.h"
+#include "MatchTrie.h"
+#include "Segmenter.h"
+
+/**
+ * Bounded map from case folded words to their greedy tokens, shared by all threads.
+ * Keys are spread over shards with a lock each, and when a shard is full an entry not read since the clock hand
+ * last passed it is replaced (CLOCK). In front of the shards, every thread keeps a small direct-mapped copy of
+ * the words it saw last, so frequent words are served without taking any lock.
+ * Words whose tokens depend on what follows them are remembered too, as uncacheable, so they go straight to matching.
+ */
+class WordCache {
+public:
+	// Longer keys are rare and cheap to match compared to their hashing, so they are never cached
+	static constexpr size_t kMaxKey = 48;
+
+	struct Stats {
+		size_t hits = 0;      // words whose tokens came from the cache
+		size_t misses = 0;    // words that were matched, cacheable or not
+		size_t evictions = 0;
+		size_t entries = 0;
+	};
+
+	/**
+	 * A thread's own copy of recently used words. Only short words with few tokens fit.
+	 */
+	struct Local {
+		static constexpr size_t kSlots = 1 << 10;
+		static constexpr size_t kMaxKey = 22;
+		static constexpr size_t kMaxTokens = 8;
+
+		struct Slot {
+			uint8_t key_len = 0; // 0 if the slot is empty
+			uint8_t token_cnt = 0; // 0 if the word isn't cacheable
+			char key[kMaxKey];
+			uint8_t lens[kMaxTokens];
+			uint32_t ids[kMaxTokens];
+		};
+
+		uint64_t owner = 0;
+		std::array <Slot, kSlots> slots;
+
+		Slot *Find(const std::string_view key, const size_t hash) {
+			Slot &slot = slots[hash % kSlots];
+			if (slot.key_len != key.size() || memcmp(slot.key, key.data(), key.size()) != 0) return nullptr;
+			return &slot;
+		}
+		void Store(std::string_view key, size_t hash, std::span <const uint32_t> ids, std::span <const uint16_t> lens);
+	};
+
+private:
+	static constexpr size_t kShardBits = 6;
+
+	struct Entry {
+		std::string key;
+		bool cacheable = false;
+		bool referenced = false;
+		std::vector <uint32_t> ids;
+		std::vector <uint16_t> lens;
+	};
+	struct alignas(64) Shard {
+		std::mutex mutex;
+		std::vector <Entry> entries;                         // never reallocated, index views their keys
+		std::unordered_map <std::string_view, size_t> index; // key to position in entries
+		size_t hand = 0;
+		size_t evictions = 0;
+	};
+
+	const uint64_t serial_;
+	std::vector <Shard> shards_;
+	size_t shard_capacity_;
+	std::atomic <size_t> hits_ = 0;
+	std::atomic <size_t> misses_ = 0;
+
+	Shard &GetShard(size_t hash);
+
+public:
+	enum Result {
+		ABSENT,
+		UNCACHEABLE,
+		FOUND
+	};
+
+	/**
+	 * @param capacity The most words kept over all shards
+	 */
+	explicit WordCache(size_t capacity);
+
+	[[nodiscard]] static size_t Hash(const std::string_view key) { return std::hash <std::string_view>()(key); }
+	/**
+	 * @return The calling thread's local copy, emptied first if it last served another cache
+	 */
+	Local &GetLocal() const;
+
+	/**
+	 * Looks a key up in the shared shards, copying its tokens into ids and lens when FOUND
+	 */
+	Result Lookup(std::string_view key, size_t hash, std::vector <uint32_t> &ids, std::vector <uint16_t> &lens);
+	/**
+	 * Adds a key, with empty ids if its tokens depend on what follows it
+	 */
+	void Insert(std::string_view key, size_t hash, std::span <const uint32_t> ids, std::span <const uint16_t> lens);
+	void Count(const size_t hits, const size_t misses) {
+		hits_.fetch_add(hits, std::memory_order_relaxed);
+		misses_.fetch_add(misses, std::memory_order_relaxed);
+	}
+
+	[[nodiscard]] Stats GetStats();
+	/**
+	 * Empties the shared shards. Thread copies stay, which is harmless since a word's tokens never change.
+	 */
+	void Clear();
+};
+
+/**
+ * Greedy segmentation that reuses the tokens of words seen before, with the same result as SegmentGreedy.
+ * The text is walked in pieces of leading whitespace plus a word, keyed together with the delimiter byte after them.
+ * A piece is only cached if no token starting in it could reach past that delimiter, whatever follows it,
+ * so its tokens depend on the key alone.
+ * @param scratch Its folded, id and len buffers are used
+ */
+template <class Emit>
+void SegmentCached(const MatchTrie &matcher, const std::string_view text, WordCache &cache, SegmentScratch &scratch,
+                   Emit &&emit) {
+	const auto is_delimiter = [](const char chr) {
+		constexpr uint64_t kSpaces = 1ULL << ' ' | 1ULL << '\t' | 1ULL << '\n' | 1ULL << '\r' | 1ULL << '\f' | 1ULL << '\v';
+		return (uint8_t)chr <= ' ' && (kSpaces >> chr & 1);
+	};
+
+	scratch.folded.resize(text.size());
+	FoldCase(text.data(), text.size(), scratch.folded.data());
+	const std::string_view folded = scratch.folded;
+	const char *end = folded.data() + folded.size();
+	WordCache::Local &local = cache.GetLocal();
+	size_t hits = 0;
+	size_t misses = 0;
+	size_t pos = 0;
+	while (pos < folded.size()) {
+		size_t word_end = pos;
+		while (word_end < folded.size() && is_delimiter(folded[word_end])) word_end++;
+		while (word_end < folded.size() && !is_delimiter(folded[word_end])) word_end++;
+		const std::string_view key = folded.substr(pos, word_end - pos + (word_end < folded.size()));
+		const size_t hash = key.size() <= WordCache::kMaxKey ? WordCache::Hash(key) : 0;
+
+		WordCache::Result found = WordCache::ABSENT;
+		if (key.size() <= WordCache::kMaxKey) {
+			if (const WordCache::Local::Slot *slot = local.Find(key, hash); slot != nullptr) {
+				found = slot->token_cnt == 0 ? WordCache::UNCACHEABLE : WordCache::FOUND;
+				if (found == WordCache::FOUND) {
+					for (size_t i = 0; i < slot->token_cnt; i++) {
+						emit(slot->ids[i], pos, (size_t)slot->lens[i]);
+						pos += slot->lens[i];
+					}
+				}
+			}
+			else {
+				found = cache.Lookup(key, hash, scratch.id, scratch.len);
+				local.Store(key, hash, found == WordCache::FOUND ? scratch.id : std::span <const uint32_t>(),
+				            found == WordCache::FOUND ? scratch.len : std::span <const uint16_t>());
+				if (found == WordCache::FOUND) {
+					for (size_t i = 0; i < scratch.id.size(); i++) {
+						emit(scratch.id[i], pos, (size_t)scratch.len[i]);
+						pos += scratch.len[i];
+					}
+				}
+			}
+			if (found == WordCache::FOUND) {
+				hits++;
+				continue;
+			}
+		}
+
+		misses++;
+		bool cacheable = found == WordCache::ABSENT && key.size() <= WordCache::kMaxKey;
+		scratch.id.clear();
+		scratch.len.clear();
+		while (pos < word_end) {
+			uint32_t id;
+			const size_t len = std::max(matcher.LongestMatch(folded.data() + pos, end, id), (size_t)1);
+			emit(id, pos, len);
+			if (cacheable) {
+				cacheable = pos + matcher.PrefixDepth(folded.data() + pos, end) <= word_end;
+				scratch.id.push_back(id);
+				scratch.len.push_back(len);
+			}
+			pos += len;
+		}
+		if (found == WordCache::ABSENT && key.size() <= WordCache::kMaxKey) {
+			if (!cacheable) {
+				scratch.id.clear();
+				scratch.len.clear();
+			}
+			cache.Insert(key, hash, scratch.id, scratch.len);
+			local.Store(key, hash, scratch.id, scratch.len);
+		}
+	}
+	cache.Count(hits, misses);
+}
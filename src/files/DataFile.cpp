@@ -1,32 +1,94 @@
 #include "DataFile.h"
 
-bool DataFile::Validate() {
-	if (doc_.HasParseError()) return false;
-	if (!doc_.IsArray()) return false;
-	if (doc_.Empty()) return false;
-	for (const auto &entry : doc_.GetArray()) {
-		if (!entry.IsObject()) return false;
-		if (!entry.HasMember("id")) return false;
-		if (!entry["id"].IsString()) return false;
-		if (!entry.HasMember("text")) return false;
-		if (!entry["text"].IsString()) return false;
-		if (!entry.HasMember("title")) return false;
-		if (!entry["title"].IsString()) return false;
+#include <algorithm>
+
+constexpr size_t kReadBuffer = 1 << 16;
+constexpr std::string_view kFieldNames[] = {"id", "title", "text"};
+
+// Depth 0 is outside the top array, 1 inside it, 2 inside an article, deeper is inside a member that is skipped
+bool DataFile::Handler::Default() {
+	if (depth <= 1) return false;
+	if (depth == 2 && field != OTHER) return false;
+	return true;
+}
+
+bool DataFile::Handler::String(const char *str, const rapidjson::SizeType len, bool) {
+	if (depth != 2 || field == OTHER) return Default();
+	// Like the DOM lookup did, the first of repeated members wins
+	if (!seen[field]) values[field].assign(str, len);
+	seen[field] = true;
+	return true;
+}
+
+bool DataFile::Handler::Key(const char *str, const rapidjson::SizeType len, bool) {
+	if (depth != 2) return true;
+	field = OTHER;
+	for (int i = ID; i < OTHER; i++) {
+		if (kFieldNames[i] == std::string_view(str, len)) field = (Field)i;
+	}
+	return true;
+}
+
+bool DataFile::Handler::StartObject() {
+	if (depth == 0) return false;
+	if (depth == 2 && field != OTHER) return false;
+	if (depth == 1) std::fill(std::begin(seen), std::end(seen), false);
+	depth++;
+	return true;
+}
+
+bool DataFile::Handler::EndObject(rapidjson::SizeType) {
+	if (--depth != 1) return true;
+	for (const bool found : seen) {
+		if (!found) return false;
 	}
+	entry_cnt++;
+	entry_done = true;
 	return true;
 }
 
-// TODO see if loading entries affects performance
-DataFile::DataFile(const std::string &path) : JsonFile(path, false) {
-	if (valid_) valid_ = Validate();
+bool DataFile::Handler::StartArray() {
+	if (depth == 2 && field != OTHER) return false;
+	if (depth == 1) return false;
+	depth++;
+	return true;
 }
 
-std::vector <DataFile::Entry> DataFile::GetEntries() const {
-	std::vector <Entry> entries;
-	for (const auto &entry : doc_.GetArray()) {
-		entries.emplace_back(entry["id"].GetString(),
-		                     entry["title"].GetString(),
-		                     entry["text"].GetString());
+bool DataFile::Handler::EndArray(rapidjson::SizeType) {
+	return --depth != 0 || entry_cnt != 0;
+}
+
+DataFile::DataFile(const std::filesystem::path &path) :
+	file_(fopen(path.c_str(), "r")),
+	valid_(file_ != nullptr) {
+	if (file_ == nullptr) return;
+	buffer_.resize(kReadBuffer);
+	stream_.emplace(file_, buffer_.data(), buffer_.size());
+	reader_.IterativeParseInit();
+}
+DataFile::~DataFile() {
+	if (file_ != nullptr) fclose(file_);
+}
+
+bool DataFile::Next(Entry &entry) {
+	if (!valid_ || done_) return false;
+	handler_.entry_done = false;
+	while (!handler_.entry_done) {
+		if (!reader_.IterativeParseNext <rapidjson::kParseDefaultFlags>(*stream_, handler_)) {
+			valid_ = false;
+			return false;
+		}
+		if (reader_.IterativeParseComplete()) {
+			done_ = true;
+			return false;
+		}
 	}
-	return entries;
+	entry = {handler_.values[ID], handler_.values[TITLE], handler_.values[TEXT]};
+	return true;
+}
+
+bool DataFile::Validate() {
+	Entry entry;
+	while (Next(entry)) {}
+	return valid_;
 }
@@ -1,21 +1,106 @@
 #pragma once
 
+#include <cstdio>
+#include <filesystem>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <vector>
 
-#include "JsonFile.h"
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/reader.h"
 
+/**
+ * Streams the articles of a data file: a non-empty json array of objects, each with string "id", "title" and "text"
+ * members (others are skipped). The file is parsed with the SAX reader one article at a time, validating as it goes,
+ * so memory doesn't grow with the file.
+ * Entries hold views into buffers that are reused for the next article, copy what must outlive the iteration.
+ */
+class DataFile {
+public:
+	struct Entry {
+		std::string_view id;
+		std::string_view title;
+		std::string_view text;
+	};
 
-class DataFile : public JsonFile {
-	bool Validate();
+private:
+	enum Field {
+		ID,
+		TITLE,
+		TEXT,
+		OTHER
+	};
+
+	// Receives the SAX events and keeps the article being parsed
+	struct Handler : rapidjson::BaseReaderHandler <rapidjson::UTF8 <>, Handler> {
+		size_t depth = 0;
+		Field field = OTHER;
+		std::string values[OTHER];
+		bool seen[OTHER] = {};
+		size_t entry_cnt = 0;
+		bool entry_done = false;
+
+		bool Default();
+		bool String(const char *str, rapidjson::SizeType len, bool copy);
+		bool Key(const char *str, rapidjson::SizeType len, bool copy);
+		bool StartObject();
+		bool EndObject(rapidjson::SizeType member_cnt);
+		bool StartArray();
+		bool EndArray(rapidjson::SizeType element_cnt);
+	};
+
+	FILE *file_ = nullptr;
+	std::vector <char> buffer_;
+	std::optional <rapidjson::FileReadStream> stream_;
+	rapidjson::Reader reader_;
+	Handler handler_;
+	bool valid_;
+	bool done_ = false;
 
 public:
-	struct Entry {
-		const std::string id;
-		const std::string title;
-		const std::string text;
+	class Iterator {
+		DataFile *file_;
+		Entry entry_;
+
+	public:
+		explicit Iterator(DataFile *file) : file_(file) { ++*this; }
+
+		const Entry &operator*() const { return entry_; }
+		const Entry *operator->() const { return &entry_; }
+		Iterator &operator++() {
+			if (!file_->Next(entry_)) file_ = nullptr;
+			return *this;
+		}
+		bool operator!=(std::default_sentinel_t) const { return file_ != nullptr; }
 	};
 
-	explicit DataFile(const std::string &path);
+	explicit DataFile(const std::filesystem::path &path);
+	DataFile(const DataFile &) = delete;
+	DataFile &operator=(const DataFile &) = delete;
+	~DataFile();
+
+	/**
+	 * @return False if the file couldn't be opened or anything read from it so far is invalid.
+	 * Check it after the last entry, articles before an error are still returned.
+	 */
+	[[nodiscard]] bool IsValid() const { return valid_; }
+
+	/**
+	 * Parses the next article
+	 * @return False at the end of the file or at the first error
+	 */
+	bool Next(Entry &entry);
+	/**
+	 * Parses the rest of the file without returning anything
+	 * @return IsValid once the whole file is read
+	 */
+	bool Validate();
 
-	[[nodiscard]] std::vector <Entry> GetEntries () const;
-};
\ No newline at end of file
+	/**
+	 * Reads the entries on the fly, so iterate only once
+	 */
+	Iterator begin() { return Iterator(this); }
+	std::default_sentinel_t end() { return std::default_sentinel; }
+};
@@ -0,0 +1,190 @@
+#include "DatasetWriter.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "DataFile.h"
+#include "MetadataFile.h"
+#include "SolutionFile.h"
+#include "../utils/Multithread.h"
+
+namespace fs = std::filesystem;
+
+static_assert(std::endian::native == std::endian::little, "Datasets are written in little endian");
+
+constexpr char kMagic[8] = {'T', 'K', 'N', 'D', 'S', 'E', 'T', '\0'};
+constexpr uint32_t kFormat = 1;
+// Smallest step the ids file is preallocated by, so a corpus of small files doesn't extend it for each one
+constexpr uint64_t kPreallocStep = 64 << 20;
+// Text tokenized per Append, while the next batch is read
+constexpr size_t kBatchBytes = 32 << 20;
+
+bool WriteAt(const int fd, const char *data, size_t size, uint64_t pos) {
+	while (size > 0) {
+		const ssize_t written = pwrite(fd, data, size, (off_t)pos);
+		if (written < 0 && errno == EINTR) continue;
+		if (written <= 0) return false;
+		data += written;
+		size -= written;
+		pos += written;
+	}
+	return true;
+}
+
+// Makes the renames into the directory of file durable
+bool SyncDirectory(const fs::path &file) {
+	const fs::path dir = file.has_parent_path() ? file.parent_path() : fs::path(".");
+	const int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1) return false;
+	const bool ok = fsync(fd) == 0;
+	close(fd);
+	return ok;
+}
+
+DatasetWriter::DatasetWriter(std::string path, const IdWidth width) :
+	path_(std::move(path)),
+	width_(width) {
+	fd_ = open((path_ + ".ids.tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+}
+DatasetWriter::~DatasetWriter() {
+	Abort();
+}
+
+void DatasetWriter::Abort() {
+	if (fd_ == -1) return;
+	close(fd_);
+	fd_ = -1;
+	unlink((path_ + ".ids.tmp").c_str());
+	unlink((path_ + ".idx.tmp").c_str());
+}
+
+bool DatasetWriter::Reserve(const uint64_t size) {
+	if (written_ + size <= allocated_) return true;
+	// Grow by half the file at least, so the number of extensions stays logarithmic
+	const uint64_t target = std::max(written_ + size, allocated_ + std::max(allocated_ / 2, kPreallocStep));
+	const int err = posix_fallocate(fd_, (off_t)allocated_, (off_t)(target - allocated_));
+	// Filesystems without fallocate support fall back to plain writes
+	if (err == ENOSPC || err == EFBIG || err == EBADF || err == EIO) return false;
+	allocated_ = target;
+	return true;
+}
+
+template <TokenId Id>
+bool DatasetWriter::AppendAs(const SolutionFile &tkn, const std::vector <std::string_view> &docs,
+                             ThreadPool &pool) {
+	const SolutionFile::TokenizedBatch <Id> batch = tkn.TokenizeBatch <Id>(docs, pool);
+	const size_t size = batch.ids.size() * sizeof(Id);
+	if (!Reserve(size) || !WriteAt(fd_, (const char *)batch.ids.data(), size, written_)) return false;
+	written_ += size;
+	const uint64_t base = offsets_.back();
+	for (size_t doc = 1; doc < batch.offsets.size(); doc++) {
+		offsets_.push_back(base + batch.offsets[doc]);
+	}
+	return true;
+}
+
+bool DatasetWriter::Append(const SolutionFile &tkn, const std::vector <std::string_view> &docs, ThreadPool &pool) {
+	if (fd_ == -1) return false;
+	const bool ok = width_ == ID16 ? AppendAs <uint16_t>(tkn, docs, pool) : AppendAs <uint32_t>(tkn, docs, pool);
+	if (!ok) Abort();
+	return ok;
+}
+
+bool DatasetWriter::Finish() {
+	if (fd_ == -1) return false;
+	IndexHeader header {};
+	memcpy(header.magic, kMagic, sizeof kMagic);
+	header.format = kFormat;
+	header.id_bytes = width_ == ID16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	header.doc_cnt = GetDocCount();
+	header.token_cnt = GetTokenCount();
+
+	const int index_fd = open((path_ + ".idx.tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	bool ok = index_fd != -1 &&
+	          WriteAt(index_fd, (const char *)&header, sizeof header, 0) &&
+	          WriteAt(index_fd, (const char *)offsets_.data(), offsets_.size() * sizeof(uint64_t), sizeof header);
+	// On disk before the renames, so the final names never point to data a crash could still lose
+	ok = ok && fdatasync(index_fd) == 0;
+	if (index_fd != -1) ok = close(index_fd) == 0 && ok;
+	ok = ok && ftruncate(fd_, (off_t)written_) == 0 && fdatasync(fd_) == 0;
+	if (!ok) {
+		Abort();
+		return false;
+	}
+	close(fd_);
+	fd_ = -1;
+
+	std::error_code err;
+	fs::rename(path_ + ".ids.tmp", path_ + ".ids", err);
+	if (err) {
+		fs::remove(path_ + ".ids.tmp", err);
+		fs::remove(path_ + ".idx.tmp", err);
+		return false;
+	}
+	fs::rename(path_ + ".idx.tmp", path_ + ".idx", err);
+	if (err) {
+		// New ids next to a missing or stale index would read as a valid dataset, so don't leave them
+		fs::remove(path_ + ".ids", err);
+		fs::remove(path_ + ".idx.tmp", err);
+		return false;
+	}
+	return SyncDirectory(path_);
+}
+
+bool WriteDataset(const MetadataFile &metadata, const SolutionFile &tkn, const std::string &path, ThreadPool &pool) {
+	// The text of consecutive articles, across files, with where each one ends
+	struct Batch {
+		std::string text;
+		std::vector <size_t> ends;
+	};
+	const std::vector <MetadataFile::Entry> files = metadata.GetFiles();
+	const fs::path root_path = metadata.GetRootPath();
+	size_t file = 0;
+	std::unique_ptr <DataFile> data;
+	const auto fill = [&files, &root_path, &file, &data](Batch &batch) {
+		batch.text.clear();
+		batch.ends.clear();
+		DataFile::Entry entry;
+		while (batch.text.size() < kBatchBytes && file < files.size()) {
+			if (data == nullptr) data = std::make_unique <DataFile>(root_path / files[file].path);
+			if (data->Next(entry)) {
+				batch.text += entry.text;
+				batch.ends.push_back(batch.text.size());
+				continue;
+			}
+			if (!data->IsValid()) std::cerr << "Invalid data file " << files[file].path << ", only read up to the error" << std::endl;
+			data.reset();
+			file++;
+		}
+	};
+
+	DatasetWriter writer(path, tkn.GetIdWidth());
+	if (!writer.IsValid()) return false;
+	Batch current;
+	Batch next;
+	fill(current);
+	std::vector <std::string_view> docs;
+	while (!current.ends.empty()) {
+		// Reading gets a thread of its own, the pool is all for tokenizing
+		std::future <void> prefetch = std::async(std::launch::async, [&fill, &next] { fill(next); });
+		docs.clear();
+		for (size_t doc = 0, begin = 0; doc < current.ends.size(); begin = current.ends[doc++]) {
+			docs.emplace_back(current.text.data() + begin, current.ends[doc] - begin);
+		}
+		const bool appended = writer.Append(tkn, docs, pool);
+		prefetch.get();
+		if (!appended) return false;
+		std::swap(current, next);
+	}
+	return writer.Finish();
+}
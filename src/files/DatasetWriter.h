@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../encoder/TokenId.h"
+
+class MetadataFile;
+class SolutionFile;
+class ThreadPool;
+
+/**
+ * Writes a tokenized corpus for training as two files:
+ *  - <path>.ids: the ids of every document back to back, each from <START> to <END>,
+ *    as little endian uint16 when the vocabulary fits and uint32 otherwise
+ *  - <path>.idx: an IndexHeader, then doc_cnt + 1 little endian uint64 offsets into the ids:
+ *    document i owns ids [offsets[i], offsets[i + 1])
+ * Ids are written in document order with pwrite into space preallocated ahead of them, so the file is never
+ * fragmented by growing a little at a time. Both files appear under their final names only once Finish succeeds.
+ */
+class DatasetWriter {
+public:
+	struct IndexHeader {
+		char magic[8];
+		uint32_t format;
+		uint32_t id_bytes;
+		uint64_t doc_cnt;
+		uint64_t token_cnt;
+	};
+
+private:
+	std::string path_;
+	IdWidth width_;
+	int fd_ = -1;
+	uint64_t written_ = 0;   // bytes of ids
+	uint64_t allocated_ = 0; // bytes preallocated in the ids file
+	std::vector <uint64_t> offsets_ = {0};
+
+	// Preallocates the ids file for size more bytes
+	bool Reserve(uint64_t size);
+	void Abort();
+	template <TokenId Id>
+	bool AppendAs(const SolutionFile &tkn, const std::vector <std::string_view> &docs, ThreadPool &pool);
+
+public:
+	/**
+	 * Creates the temporary ids file
+	 * @param width The width of the ids on disk, normally SolutionFile::GetIdWidth
+	 */
+	DatasetWriter(std::string path, IdWidth width);
+	DatasetWriter(const DatasetWriter &) = delete;
+	DatasetWriter &operator=(const DatasetWriter &) = delete;
+	/**
+	 * Removes the temporary files if Finish wasn't called or failed
+	 */
+	~DatasetWriter();
+
+	[[nodiscard]] bool IsValid() const { return fd_ != -1; }
+	[[nodiscard]] uint64_t GetDocCount() const { return offsets_.size() - 1; }
+	[[nodiscard]] uint64_t GetTokenCount() const { return offsets_.back(); }
+
+	/**
+	 * Tokenizes documents on the pool and appends their ids after everything written so far
+	 * @return False if writing failed, after which the writer is invalid
+	 */
+	bool Append(const SolutionFile &tkn, const std::vector <std::string_view> &docs, ThreadPool &pool);
+	/**
+	 * Trims the preallocated space, writes the index, flushes both files to disk and moves them to their final names
+	 * @return False if any step failed. The files are only left under their final names if just the last sync of
+	 *		the directory failed, when the renames may not survive a crash.
+	 */
+	bool Finish();
+};
+
+/**
+ * Tokenizes every entry of every data file the metadata lists into a dataset at path.
+ * Articles are streamed in batches, the next one parsed on its own thread while the pool tokenizes the current one.
+ * @return False if the dataset couldn't be written. Data files are read up to their first invalid entry.
+ */
+bool WriteDataset(const MetadataFile &metadata, const SolutionFile &tkn, const std::string &path, ThreadPool &pool);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <span>
+
+/**
+ * The compiled image of the vocabulary frozen into the binary, to be passed to SolutionFile.
+ * It is generated by vocabgen and only defined in builds configured with TOKENIZER_FROZEN_VOCAB.
+ */
+std::span <const char> GetFrozenVocab();
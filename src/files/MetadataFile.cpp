@@ -49,7 +49,7 @@ void MetadataFile::BuildDoc() {
 			if (path.extension() != ".json") continue;
 
 			pool.Enqueue([&root_path, &alloc, path = std::move(path), &mutex, &file_array] {
-				if (!DataFile(path).IsValid()) return false;
+				if (!DataFile(path).Validate()) return false;
 				json::Value object(json::kObjectType);
 				object.AddMember("path", json::Value(fs::relative(path, root_path).c_str(), alloc), alloc);
 				{
@@ -1,15 +1,61 @@
 #include "SolutionFile.h"
 
 #include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
-#include <ranges>
+#include <mutex>
+#include <numeric>
+
+#include <unistd.h>
 
 #include "../config.h"
+#include "../utils/Multithread.h"
 
 namespace json = rapidjson;
+namespace fs = std::filesystem;
 
 const std::string kStartToken = "<START>";
 const std::string kEndToken = "<END>";
+constexpr std::string_view kUnknownToken = "<UNKNOWN>";
+constexpr size_t kFirstTextId = 2;
+// Chunks per pool thread in batch calls, so one slow chunk doesn't leave the other threads idle
+constexpr size_t kChunksPerThread = 4;
+constexpr size_t kMinChunkBytes = 1 << 16;
+constexpr size_t kMinSegmentBytes = 1 << 20;
+// How far past a nominal cut to look for whitespace, and how many token starts of a segment to remember for stitching
+constexpr size_t kCutSearch = 256;
+constexpr size_t kSyncWindow = 64;
+
+size_t FindCut(const std::string_view input, const size_t from) {
+	const size_t to = std::min(input.size(), from + kCutSearch);
+	for (size_t pos = from; pos < to; pos++) {
+		if (std::isspace((unsigned char)input[pos - 1])) return pos;
+	}
+	// No whitespace nearby, at least avoid cutting through a UTF-8 sequence
+	size_t pos = from;
+	while (pos < input.size() && ((unsigned char)input[pos] & 0xC0) == 0x80) pos++;
+	return pos;
+}
+
+std::string CompiledPath(const std::string &path) {
+	return fs::path(path).replace_extension(".bin").string();
+}
+
+VocabFile LoadCompiled(const std::string &path) {
+	VocabFile compiled(CompiledPath(path));
+	// Any change to the json makes it stale, not only a newer time. Without the json, the compiled copy is all there is.
+	const std::optional <VocabFile::Source> source = VocabFile::Source::Of(path);
+	if (source && compiled.GetSource() != *source) return {};
+	return compiled;
+}
+
+// Compiles next to the json, stamped with the json as it is now on disk
+void SaveCompiled(const VocabFile &vocab, const std::string &path) {
+	vocab.Save(CompiledPath(path), VocabFile::Source::Of(path).value_or(VocabFile::Source()));
+}
 
 bool SolutionFile::Validate() {
 	if (!doc_.IsObject()) return false;
@@ -22,6 +68,18 @@ bool SolutionFile::Validate() {
 	for (const auto &entry : doc_["tokens"].GetArray()) {
 		if (!entry.IsString()) return false;
 	}
+
+	if (!doc_.HasMember("order")) return true;
+	if (!doc_["order"].IsArray()) return false;
+	const size_t token_cnt = doc_["tokens"].Size();
+	if (doc_["order"].Size() != token_cnt) return false;
+	std::vector <bool> seen(token_cnt);
+	for (const auto &entry : doc_["order"].GetArray()) {
+		if (!entry.IsUint()) return false;
+		const size_t id = entry.GetUint();
+		if (id < kFirstTextId || id >= kFirstTextId + token_cnt || seen[id - kFirstTextId]) return false;
+		seen[id - kFirstTextId] = true;
+	}
 	return true;
 }
 void SolutionFile::BuildDoc() {
@@ -32,87 +90,561 @@ void SolutionFile::BuildDoc() {
 	doc_.AddMember("version", json::StringRef(kBuildVersion.c_str()), alloc);
 
 	json::Value tokens(json::kArrayType);
-	for (size_t i = 2; i < ids_.size(); i++) {
-		tokens.PushBack(json::Value(ids_[i]->c_str(), alloc), alloc);
+	for (size_t i = kFirstTextId; i < vocab_.size(); i++) {
+		tokens.PushBack(json::Value(vocab_.GetToken(i).data(), alloc), alloc);
 	}
 	doc_.AddMember("tokens", tokens, alloc);
 
+	const std::span <const uint32_t> order = vocab_.GetOrder();
+	if (!order.empty()) {
+		json::Value original(json::kArrayType);
+		for (size_t i = kFirstTextId; i < order.size(); i++) {
+			original.PushBack(order[i], alloc);
+		}
+		doc_.AddMember("order", original, alloc);
+	}
+
 	Save();
 }
+void SolutionFile::LoadVocab(VocabFile &&vocab) {
+	vocab_ = std::move(vocab);
+	matcher_ = vocab_.GetMatcher();
+	index_ = vocab_.GetIndex();
+}
 
 SolutionFile::SolutionFile(const std::string &path):
-	JsonFile(path, false),
-	max_len_(0) {
+	SolutionFile(path, LoadCompiled(path)) {}
+SolutionFile::SolutionFile(const std::string &path, VocabFile &&compiled):
+	JsonFile(path, compiled.IsValid()) {
+	if (compiled.IsValid()) {
+		valid_ = true;
+		LoadVocab(std::move(compiled));
+		return;
+	}
 	if (valid_) valid_ = Validate();
 	if (!valid_) return;
 
-	ids_.resize(doc_["tokens"].GetArray().Size() + 2);
-	size_t cnt = 0;
-	ids_[cnt++] = &kStartToken;
-	ids_[cnt++] = &kEndToken;
+	std::vector <std::string_view> tokens = {kStartToken, kEndToken};
 	for (const auto &entry : doc_["tokens"].GetArray()) {
-		std::string token = entry.GetString();
-		max_len_ = std::max(max_len_, token.size());
-		ids_[cnt++] = &tokens_.insert({std::move(token), cnt}).first->first;
+		tokens.emplace_back(entry.GetString());
 	}
+	std::vector <uint32_t> order;
+	if (doc_.HasMember("order")) {
+		order = {kStartId, kEndId};
+		for (const auto &entry : doc_["order"].GetArray()) {
+			order.push_back(entry.GetUint());
+		}
+	}
+	LoadVocab(VocabFile(VocabFile::Build(tokens, kFirstTextId, order)));
+	SaveCompiled(vocab_, path_);
 }
 SolutionFile::SolutionFile(const std::vector <std::string> &tokens, const std::string &path):
-	JsonFile(path, true),
-	ids_(tokens.size() + 2),
-	max_len_(0) {
+	JsonFile(path, true) {
+	std::vector <std::string_view> all = {kStartToken, kEndToken};
+	all.insert(all.end(), tokens.begin(), tokens.end());
+	LoadVocab(VocabFile(VocabFile::Build(all, kFirstTextId)));
+	BuildDoc();
+	SaveCompiled(vocab_, path_);
+}
+SolutionFile::SolutionFile(VocabFile &&compiled):
+	SolutionFile("", std::move(compiled)) {}
+
+void SolutionFile::EnableWordCache(const size_t capacity) {
+	word_cache_ = std::make_unique <WordCache>(capacity);
+}
+void SolutionFile::DisableWordCache() {
+	word_cache_.reset();
+}
+WordCache::Stats SolutionFile::GetWordCacheStats() const {
+	return word_cache_ == nullptr ? WordCache::Stats() : word_cache_->GetStats();
+}
+
+void SolutionFile::EnableDocumentCache(const size_t max_bytes) {
+	doc_cache_ = std::make_unique <DocumentCache>(max_bytes);
+}
+void SolutionFile::DisableDocumentCache() {
+	doc_cache_.reset();
+}
+void SolutionFile::BypassDocumentCache(const bool bypass) {
+	if (doc_cache_ != nullptr) doc_cache_->SetBypass(bypass);
+}
+DocumentCache::Stats SolutionFile::GetDocumentCacheStats() const {
+	return doc_cache_ == nullptr ? DocumentCache::Stats() : doc_cache_->GetStats();
+}
+
+template <class Emit>
+void SolutionFile::SegmentText(const std::string_view input, const Segmentation mode, SegmentScratch &scratch,
+                               Emit &&emit) const {
+	if (mode == GREEDY && word_cache_ != nullptr) {
+		SegmentCached(matcher_, input, *word_cache_, scratch, emit);
+		return;
+	}
+	if (mode == GREEDY) {
+		SegmentGreedy(matcher_, input, emit);
+		return;
+	}
+	Segment(matcher_, input, mode, scratch, emit);
+}
+
+size_t SolutionFile::GetId(const std::string_view token) const {
+	const uint32_t id = index_.Lookup(token);
+	if (id == PerfectHash::kNoId || vocab_.GetToken(id) != token) return -1;
+	return id;
+}
+
+const char* SolutionFile::GetToken(const size_t id) const {
+	return TokenBytes(id).data();
+}
+
+std::vector <size_t> SolutionFile::Tokenize(const std::string_view input) const {
+	std::vector <uint32_t> compact;
+	Tokenize(input, compact);
+	std::vector <size_t> ids(compact.size());
+	std::ranges::transform(compact, ids.begin(), [](const uint32_t id) {
+		return id == kUnknownId ? (size_t)-1 : id;
+	});
+	return ids;
+}
+
+template <TokenId Id>
+size_t SolutionFile::Tokenize(const std::string_view input, const std::span <Id> out,
+                              const Segmentation mode) const {
+	SegmentScratch scratch;
+	return Tokenize(input, out, scratch, mode);
+}
+template size_t SolutionFile::Tokenize(std::string_view, std::span <uint16_t>, Segmentation) const;
+template size_t SolutionFile::Tokenize(std::string_view, std::span <uint32_t>, Segmentation) const;
+
+template <TokenId Id>
+size_t SolutionFile::Tokenize(const std::string_view input, const std::span <Id> out, SegmentScratch &scratch,
+                              const Segmentation mode) const {
+	DocumentCache *cache = doc_cache_ != nullptr && !doc_cache_->IsBypassed() ? doc_cache_.get() : nullptr;
+	Hash128 key {};
+	if (cache != nullptr) {
+		key = DocumentCache::Key(input, mode);
+		size_t cnt;
+		if (cache->Lookup(key, out, cnt)) return cnt;
+	}
+
+	size_t cnt = 0;
+	const auto push = [&out, &cnt](const uint32_t id) {
+		// Narrowing keeps every id of a vocabulary that fits, and turns kNoId into the narrow kUnknown
+		if (cnt < out.size()) out[cnt] = (Id)id;
+		cnt++;
+	};
+	push(kStartId);
+	SegmentText(input, mode, scratch, [&push](const uint32_t id, size_t, size_t) { push(id); });
+	push(kEndId);
+	// Only a complete tokenization can be cached
+	if (cache != nullptr && cnt <= out.size()) cache->Insert(key, std::span <const Id>(out.first(cnt)));
+	return cnt;
+}
+template size_t SolutionFile::Tokenize(std::string_view, std::span <uint16_t>, SegmentScratch &, Segmentation) const;
+template size_t SolutionFile::Tokenize(std::string_view, std::span <uint32_t>, SegmentScratch &, Segmentation) const;
+
+template <TokenId Id>
+void SolutionFile::Tokenize(const std::string_view input, std::vector <Id> &out, const Segmentation mode) const {
+	out.resize(input.size() + 2);
+	out.resize(Tokenize(input, std::span(out), mode));
+}
+template void SolutionFile::Tokenize(std::string_view, std::vector <uint16_t> &, Segmentation) const;
+template void SolutionFile::Tokenize(std::string_view, std::vector <uint32_t> &, Segmentation) const;
+
+template <TokenId Id>
+size_t SolutionFile::Tokenize(const std::string_view input, const std::span <Id> out,
+                              const std::span <ByteRange> ranges, const Segmentation mode) const {
+	SegmentScratch scratch;
+	return Tokenize(input, out, ranges, scratch, mode);
+}
+template size_t SolutionFile::Tokenize(std::string_view, std::span <uint16_t>, std::span <ByteRange>,
+                                       Segmentation) const;
+template size_t SolutionFile::Tokenize(std::string_view, std::span <uint32_t>, std::span <ByteRange>,
+                                       Segmentation) const;
+
+template <TokenId Id>
+size_t SolutionFile::Tokenize(const std::string_view input, const std::span <Id> out,
+                              const std::span <ByteRange> ranges, SegmentScratch &scratch,
+                              const Segmentation mode) const {
+	const size_t limit = std::min(out.size(), ranges.size());
+	size_t cnt = 0;
+	const auto push = [&out, &ranges, limit, &cnt](const uint32_t id, const size_t begin, const size_t end) {
+		if (cnt < limit) {
+			out[cnt] = (Id)id;
+			ranges[cnt] = {begin, end};
+		}
+		cnt++;
+	};
+	push(kStartId, 0, 0);
+	SegmentText(input, mode, scratch, [&push](const uint32_t id, const size_t pos, const size_t len) {
+		push(id, pos, pos + len);
+	});
+	push(kEndId, input.size(), input.size());
+	return cnt;
+}
+template size_t SolutionFile::Tokenize(std::string_view, std::span <uint16_t>, std::span <ByteRange>,
+                                       SegmentScratch &, Segmentation) const;
+template size_t SolutionFile::Tokenize(std::string_view, std::span <uint32_t>, std::span <ByteRange>,
+                                       SegmentScratch &, Segmentation) const;
+
+template <TokenId Id>
+void SolutionFile::Tokenize(const std::string_view input, std::vector <Id> &out,
+                            std::vector <ByteRange> &ranges, const Segmentation mode) const {
+	out.resize(input.size() + 2);
+	ranges.resize(input.size() + 2);
+	const size_t cnt = Tokenize(input, std::span(out), std::span(ranges), mode);
+	out.resize(cnt);
+	ranges.resize(cnt);
+}
+template void SolutionFile::Tokenize(std::string_view, std::vector <uint16_t> &, std::vector <ByteRange> &,
+                                     Segmentation) const;
+template void SolutionFile::Tokenize(std::string_view, std::vector <uint32_t> &, std::vector <ByteRange> &,
+                                     Segmentation) const;
+
+// Splits documents into runs of similar byte count, several per pool thread. Returns the first document of each run.
+std::vector <size_t> SplitChunks(const std::vector <std::string_view> &docs, const ThreadPool &pool) {
+	size_t total_bytes = 0;
+	for (const std::string_view doc : docs) {
+		total_bytes += doc.size();
+	}
+	const size_t chunk_bytes = std::max(total_bytes / (kChunksPerThread * std::max(pool.size(), (size_t)1)),
+	                                    kMinChunkBytes);
+	std::vector <size_t> chunk_begin = {0};
+	for (size_t doc = 0, bytes = 0; doc < docs.size(); doc++) {
+		bytes += docs[doc].size();
+		if (bytes < chunk_bytes) continue;
+		chunk_begin.push_back(doc + 1);
+		bytes = 0;
+	}
+	if (chunk_begin.back() != docs.size()) chunk_begin.push_back(docs.size());
+	return chunk_begin;
+}
 
+template <TokenId Id>
+SolutionFile::TokenizedBatch <Id> SolutionFile::TokenizeBatch(const std::vector <std::string_view> &docs,
+                                                              ThreadPool &pool) const {
+	const std::vector <size_t> chunk_begin = SplitChunks(docs, pool);
+	TokenizedBatch <Id> batch;
+	batch.offsets.resize(docs.size() + 1);
+	std::vector <std::vector <Id>> chunk_ids(chunk_begin.size() - 1);
+	std::vector <ThreadPool::TaskRef> tasks;
+	for (size_t chunk = 0; chunk + 1 < chunk_begin.size(); chunk++) {
+		tasks.push_back(pool.Enqueue([this, &docs, &batch, &chunk_begin, &chunk_ids, chunk] {
+			std::vector <Id> &ids = chunk_ids[chunk];
+			for (size_t doc = chunk_begin[chunk]; doc < chunk_begin[chunk + 1]; doc++) {
+				const size_t begin = ids.size();
+				ids.resize(begin + docs[doc].size() + 2);
+				ids.resize(begin + Tokenize(docs[doc], std::span(ids).subspan(begin)));
+				batch.offsets[doc + 1] = ids.size() - begin;
+			}
+		}));
+	}
+	pool.Wait(std::move(tasks));
+
+	for (size_t doc = 0; doc < docs.size(); doc++) {
+		batch.offsets[doc + 1] += batch.offsets[doc];
+	}
+	batch.ids.resize(batch.offsets.back());
+	tasks.clear();
+	for (size_t chunk = 0; chunk + 1 < chunk_begin.size(); chunk++) {
+		tasks.push_back(pool.Enqueue([&batch, &chunk_begin, &chunk_ids, chunk] {
+			std::vector <Id> &ids = chunk_ids[chunk];
+			std::ranges::copy(ids, batch.ids.begin() + batch.offsets[chunk_begin[chunk]]);
+			std::vector <Id>().swap(ids);
+		}));
+	}
+	pool.Wait(std::move(tasks));
+	return batch;
+}
+template SolutionFile::TokenizedBatch <uint16_t> SolutionFile::TokenizeBatch(const std::vector <std::string_view> &,
+                                                                             ThreadPool &) const;
+template SolutionFile::TokenizedBatch <uint32_t> SolutionFile::TokenizeBatch(const std::vector <std::string_view> &,
+                                                                             ThreadPool &) const;
+
+template <TokenId Id>
+void SolutionFile::TokenizeParallel(const std::string_view input, std::vector <Id> &out, ThreadPool &pool) const {
+	const size_t seg_cnt = std::min(kChunksPerThread * std::max(pool.size(), (size_t)1),
+	                                input.size() / kMinSegmentBytes);
+	if (seg_cnt < 2) {
+		Tokenize(input, out);
+		return;
+	}
+	std::vector <size_t> cuts = {0};
+	for (size_t seg = 1; seg < seg_cnt; seg++) {
+		const size_t cut = FindCut(input, input.size() / seg_cnt * seg);
+		if (cut > cuts.back() && cut < input.size()) cuts.push_back(cut);
+	}
+	cuts.push_back(input.size());
+
+	struct Segment {
+		std::vector <Id> ids;
+		std::vector <size_t> starts; // positions of the first kSyncWindow tokens
+		size_t end;                  // position after the last token
+		// Filled in while stitching
+		std::vector <Id> lead;       // ids re-tokenized sequentially before the synchronization point
+		size_t skip = 0;             // speculative ids replaced by lead
+	};
+	std::vector <Segment> segments(cuts.size() - 1);
+	// Cuts are on code point boundaries, so the segments fold independently
+	std::string folded(input.size(), '\0');
+	const char *end = folded.data() + folded.size();
+	const auto step = [this, &folded, end](size_t &pos) {
+		uint32_t id;
+		pos += std::max(matcher_.LongestMatch(folded.data() + pos, end, id), (size_t)1);
+		return (Id)id;
+	};
+
+	std::vector <ThreadPool::TaskRef> tasks;
+	for (size_t seg = 0; seg < segments.size(); seg++) {
+		tasks.push_back(pool.Enqueue([input, &folded, &cuts, seg] {
+			FoldCase(input.data() + cuts[seg], cuts[seg + 1] - cuts[seg], folded.data() + cuts[seg]);
+		}));
+	}
+	pool.Wait(std::move(tasks));
+	tasks.clear();
+	for (size_t seg = 0; seg < segments.size(); seg++) {
+		tasks.push_back(pool.Enqueue([&segments, &cuts, &step, seg] {
+			Segment &segment = segments[seg];
+			segment.ids.reserve(cuts[seg + 1] - cuts[seg]);
+			size_t pos = cuts[seg];
+			while (pos < cuts[seg + 1]) {
+				if (segment.starts.size() < kSyncWindow) segment.starts.push_back(pos);
+				segment.ids.push_back(step(pos));
+			}
+			segment.end = pos;
+		}));
+	}
+	pool.Wait(std::move(tasks));
+
+	for (size_t seg = 1, pos = segments[0].end; seg < segments.size(); seg++) {
+		Segment &segment = segments[seg];
+		const auto &starts = segment.starts;
+		while (true) {
+			const auto it = std::ranges::lower_bound(starts, pos);
+			if (it != starts.end() && *it == pos) {
+				segment.skip = it - starts.begin();
+				pos = segment.end;
+				break;
+			}
+			if (pos >= cuts[seg + 1] || it == starts.end()) {
+				// Never resynchronized within the window, the whole segment is redone sequentially
+				while (pos < cuts[seg + 1]) segment.lead.push_back(step(pos));
+				segment.skip = segment.ids.size();
+				break;
+			}
+			segment.lead.push_back(step(pos));
+		}
+	}
+
+	std::vector <size_t> offsets = {1};
+	for (const Segment &segment : segments) {
+		offsets.push_back(offsets.back() + segment.lead.size() + segment.ids.size() - segment.skip);
+	}
+	out.resize(offsets.back() + 1);
+	out.front() = kStartId;
+	out.back() = kEndId;
+	tasks.clear();
+	for (size_t seg = 0; seg < segments.size(); seg++) {
+		tasks.push_back(pool.Enqueue([&segments, &offsets, &out, seg] {
+			Segment &segment = segments[seg];
+			auto to = std::ranges::copy(segment.lead, out.begin() + offsets[seg]).out;
+			std::copy(segment.ids.begin() + segment.skip, segment.ids.end(), to);
+			std::vector <Id>().swap(segment.ids);
+		}));
+	}
+	pool.Wait(std::move(tasks));
+}
+template void SolutionFile::TokenizeParallel(std::string_view, std::vector <uint16_t> &, ThreadPool &) const;
+template void SolutionFile::TokenizeParallel(std::string_view, std::vector <uint32_t> &, ThreadPool &) const;
+
+size_t SolutionFile::CountTokens(const std::string_view input, const Segmentation mode) const {
+	SegmentScratch scratch;
+	return CountTokens(input, scratch, mode);
+}
+size_t SolutionFile::CountTokens(const std::string_view input, SegmentScratch &scratch,
+                                 const Segmentation mode) const {
 	size_t cnt = 0;
-	ids_[cnt++] = &kStartToken;
-	ids_[cnt++] = &kEndToken;
-	for (const auto &token : tokens) {
-		max_len_ = std::max(max_len_, token.size());
-		ids_[cnt++] = &tokens_.insert({token, cnt}).first->first;
+	SegmentText(input, mode, scratch, [&cnt](uint32_t, size_t, size_t) { cnt++; });
+	return cnt;
+}
+
+SolutionFile::TokenCounts SolutionFile::CountTokensBatch(const std::vector <std::string_view> &docs, ThreadPool &pool,
+                                                         const Segmentation mode) const {
+	const std::vector <size_t> chunk_begin = SplitChunks(docs, pool);
+	TokenCounts counts;
+	counts.docs.resize(docs.size());
+	counts.lengths.resize(GetMaxLen() + 1);
+	std::mutex merge_mutex;
+	std::vector <ThreadPool::TaskRef> tasks;
+	for (size_t chunk = 0; chunk + 1 < chunk_begin.size(); chunk++) {
+		tasks.push_back(pool.Enqueue([this, &docs, &counts, &chunk_begin, &merge_mutex, mode, chunk] {
+			std::vector <size_t> lengths(counts.lengths.size());
+			size_t unknown = 0;
+			size_t total = 0;
+			SegmentScratch scratch;
+			for (size_t doc = chunk_begin[chunk]; doc < chunk_begin[chunk + 1]; doc++) {
+				size_t cnt = 0;
+				SegmentText(docs[doc], mode, scratch, [&](const uint32_t id, size_t, const size_t len) {
+					cnt++;
+					if (id == kUnknownId) unknown++;
+					else lengths[len]++;
+				});
+				counts.docs[doc] = cnt;
+				total += cnt;
+			}
+			std::lock_guard lock(merge_mutex);
+			counts.total += total;
+			counts.unknown += unknown;
+			for (size_t len = 0; len < lengths.size(); len++) {
+				counts.lengths[len] += lengths[len];
+			}
+		}));
+	}
+	pool.Wait(std::move(tasks));
+	return counts;
+}
+
+void SolutionFile::RenumberByFrequency(const std::vector <std::string_view> &docs, ThreadPool &pool) {
+	const std::vector <size_t> chunk_begin = SplitChunks(docs, pool);
+	std::vector <uint64_t> freq(vocab_.size());
+	std::mutex merge_mutex;
+	std::vector <ThreadPool::TaskRef> tasks;
+	for (size_t chunk = 0; chunk + 1 < chunk_begin.size(); chunk++) {
+		tasks.push_back(pool.Enqueue([this, &docs, &chunk_begin, &freq, &merge_mutex, chunk] {
+			std::vector <uint64_t> local(freq.size());
+			SegmentScratch scratch;
+			for (size_t doc = chunk_begin[chunk]; doc < chunk_begin[chunk + 1]; doc++) {
+				SegmentText(docs[doc], GREEDY, scratch, [&local](const uint32_t id, size_t, size_t) {
+					if (id != kUnknownId) local[id]++;
+				});
+			}
+			std::lock_guard lock(merge_mutex);
+			for (size_t id = 0; id < freq.size(); id++) {
+				freq[id] += local[id];
+			}
+		}));
 	}
+	pool.Wait(std::move(tasks));
+
+	// New id to current id. Control tokens keep theirs, ties keep their current order.
+	std::vector <uint32_t> current(vocab_.size());
+	std::iota(current.begin(), current.end(), 0);
+	std::stable_sort(current.begin() + kFirstTextId, current.end(), [&freq](const uint32_t x, const uint32_t y) {
+		return freq[x] > freq[y];
+	});
+	// The stored permutation always leads back to the ids the vocabulary was first saved with
+	const std::span <const uint32_t> old_order = vocab_.GetOrder();
+	std::vector <uint32_t> order(current.size());
+	std::vector <std::string_view> tokens(current.size());
+	for (size_t id = 0; id < current.size(); id++) {
+		order[id] = old_order.empty() ? current[id] : old_order[current[id]];
+		tokens[id] = vocab_.GetToken(current[id]);
+	}
+	// Build copies the tokens out of the current image before it is replaced
+	LoadVocab(VocabFile(VocabFile::Build(tokens, kFirstTextId, order)));
+	word_cache_.reset();
+	doc_cache_.reset();
+	if (path_.empty()) return;
 	BuildDoc();
+	SaveCompiled(vocab_, path_);
 }
 
-size_t SolutionFile::GetId(const std::string &token) const {
-	const auto it = tokens_.find(token);
-	return it == tokens_.end() ? -1 : it->second;
+template <class Id>
+std::string_view SolutionFile::TokenBytes(const Id id) const {
+	// Also covers the unknown id of every width, the largest value of its type
+	return (size_t)id < vocab_.size() ? vocab_.GetToken(id) : kUnknownToken;
 }
 
-const char* SolutionFile::GetToken(const size_t id) const {
-	return id == -1 ? "<UNKNOWN>" : ids_[id]->c_str();
-}
-
-std::vector <size_t> SolutionFile::Tokenize(std::string input) const {
-	std::vector <size_t> ids;
-	ids.push_back(0);
-	size_t pos = 0;
-	std::ranges::transform(input, input.begin(),
-	                       [](const unsigned char c) { return std::tolower(c); });
-	while (pos < input.size()) {
-		for (size_t len = std::min(max_len_, input.size() - pos); len > 0; --len) {
-			size_t id = GetId(input.substr(pos, len));
-			if (id == -1 && len > 1) continue;
-			ids.push_back(id);
-			pos += len;
-			break;
+template <class Ids>
+void SolutionFile::JoinTokens(const Ids &ids, const std::string_view separator, std::string &text) const {
+	text.clear();
+	if (ids.empty()) return;
+	size_t size = separator.size() * (ids.size() - 1);
+	for (const auto id : ids) {
+		size += TokenBytes(id).size();
+	}
+	text.resize(size);
+	char *to = text.data();
+	for (size_t i = 0; i < ids.size(); i++) {
+		if (i != 0) {
+			memcpy(to, separator.data(), separator.size());
+			to += separator.size();
 		}
+		const std::string_view token = TokenBytes(ids[i]);
+		memcpy(to, token.data(), token.size());
+		to += token.size();
 	}
-	ids.push_back(1);
-	return ids;
+}
+
+template <TokenId Id, class Flush>
+bool SolutionFile::StreamTokens(const std::span <const Id> ids, Flush &&flush) const {
+	char buffer[kStreamBuffer];
+	size_t used = 0;
+	for (const Id id : ids) {
+		const std::string_view token = TokenBytes(id);
+		if (used + token.size() > sizeof buffer) {
+			if (!flush(buffer, used)) return false;
+			used = 0;
+			if (token.size() > sizeof buffer) {
+				if (!flush(token.data(), token.size())) return false;
+				continue;
+			}
+		}
+		memcpy(buffer + used, token.data(), token.size());
+		used += token.size();
+	}
+	return used == 0 || flush(buffer, used);
 }
 
 std::string SolutionFile::Detokenize(const std::vector <size_t> &ids) const {
 	std::string text;
-	for (const size_t id : ids) {
-		text += GetToken(id);
-	}
+	JoinTokens(ids, "", text);
 	return text;
 }
 
+template <TokenId Id>
+std::string SolutionFile::Detokenize(const std::span <const Id> ids) const {
+	std::string text;
+	JoinTokens(ids, "", text);
+	return text;
+}
+template std::string SolutionFile::Detokenize(std::span <const uint16_t>) const;
+template std::string SolutionFile::Detokenize(std::span <const uint32_t>) const;
+
+template <TokenId Id>
+void SolutionFile::Detokenize(const std::span <const Id> ids, std::string &text) const {
+	JoinTokens(ids, "", text);
+}
+template void SolutionFile::Detokenize(std::span <const uint16_t>, std::string &) const;
+template void SolutionFile::Detokenize(std::span <const uint32_t>, std::string &) const;
+
+template <TokenId Id>
+bool SolutionFile::Detokenize(const std::span <const Id> ids, std::ostream &out) const {
+	return StreamTokens(ids, [&out](const char *data, const size_t size) {
+		out.write(data, (std::streamsize)size);
+		return out.good();
+	});
+}
+template bool SolutionFile::Detokenize(std::span <const uint16_t>, std::ostream &) const;
+template bool SolutionFile::Detokenize(std::span <const uint32_t>, std::ostream &) const;
+
+template <TokenId Id>
+bool SolutionFile::Detokenize(const std::span <const Id> ids, const int fd) const {
+	return StreamTokens(ids, [fd](const char *data, size_t size) {
+		while (size > 0) {
+			const ssize_t written = write(fd, data, size);
+			if (written < 0 && errno == EINTR) continue;
+			if (written <= 0) return false;
+			data += written;
+			size -= written;
+		}
+		return true;
+	});
+}
+template bool SolutionFile::Detokenize(std::span <const uint16_t>, int) const;
+template bool SolutionFile::Detokenize(std::span <const uint32_t>, int) const;
+
 std::string SolutionFile::Prettify(const std::vector <size_t> &ids) const {
-	std::string ans;
-	for (const size_t id : ids) {
-		ans += GetToken(id);
-		ans += '|';
-	}
-	ans.pop_back();
-	return ans;
+	std::string text;
+	JoinTokens(ids, "|", text);
+	return text;
 }
@@ -1,29 +1,253 @@
 #pragma once
 
+#include <cstdint>
+#include <iosfwd>
+#include <limits>
+#include <memory>
+#include <span>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 #include "JsonFile.h"
+#include "VocabFile.h"
+#include "../encoder/DocumentCache.h"
+#include "../encoder/MatchTrie.h"
+#include "../encoder/PerfectHash.h"
+#include "../encoder/Segmenter.h"
+#include "../encoder/TokenId.h"
+#include "../encoder/WordCache.h"
+
+class ThreadPool;
 
 class SolutionFile : JsonFile {
-	std::unordered_map <std::string, size_t> tokens_;
-	std::vector <const std::string *> ids_;
-	size_t max_len_;
+	VocabFile vocab_;
+	MatchTrie matcher_;
+	PerfectHash index_;
+	std::unique_ptr <WordCache> word_cache_;
+	std::unique_ptr <DocumentCache> doc_cache_;
 
 	bool Validate();
 
 	void BuildDoc();
+	void LoadVocab(VocabFile &&vocab);
+
+	SolutionFile(const std::string &path, VocabFile &&compiled);
+
+	// Segments with the word cache when it is enabled and the mode is greedy
+	template <class Emit>
+	void SegmentText(std::string_view input, Segmentation mode, SegmentScratch &scratch, Emit &&emit) const;
+
+	// Bytes of the stack buffer streaming Detokenize fills before each write
+	static constexpr size_t kStreamBuffer = 1 << 16;
+
+	// The bytes of an id of any width, <UNKNOWN> for the unknown id and anything out of range
+	template <class Id>
+	[[nodiscard]] std::string_view TokenBytes(Id id) const;
+	// Sizes the text in a first pass, then copies every token into it in a second
+	template <class Ids>
+	void JoinTokens(const Ids &ids, std::string_view separator, std::string &text) const;
+	// Copies tokens into a buffer, handing it to flush(data, size) whenever it fills up
+	template <TokenId Id, class Flush>
+	bool StreamTokens(std::span <const Id> ids, Flush &&flush) const;
 
 public:
+	static constexpr uint32_t kStartId = 0;
+	static constexpr uint32_t kEndId = 1;
+	template <TokenId Id>
+	static constexpr Id kUnknown = std::numeric_limits <Id>::max();
+	static constexpr uint32_t kUnknownId = kUnknown <uint32_t>;
+
+	/**
+	 * Bytes [begin, end) of the original input covered by a token
+	 */
+	struct ByteRange {
+		size_t begin;
+		size_t end;
+	};
+	/**
+	 * Ids of many documents in CSR layout: document i owns ids[offsets[i]] up to ids[offsets[i + 1]]
+	 */
+	template <TokenId Id = uint32_t>
+	struct TokenizedBatch {
+		std::vector <Id> ids;
+		std::vector <size_t> offsets;
+	};
+	/**
+	 * Token statistics of many documents. Counts never include the <START> and <END> markers.
+	 */
+	struct TokenCounts {
+		std::vector <size_t> docs;    // tokens in each document
+		size_t total = 0;
+		std::vector <size_t> lengths; // lengths[len] is the number of matched tokens of len bytes
+		size_t unknown = 0;           // bytes no token matched, each counted as one token
+	};
+
+	/**
+	 * Loads a vocabulary, preferring its compiled .tokens.bin twin when it is at least as new as the json file.
+	 * Otherwise the json file is parsed and the binary file is (re)built next to it.
+	 */
 	explicit SolutionFile(const std::string &path);
 	SolutionFile(const std::vector <std::string> &tokens, const std::string &path);
+	/**
+	 * Uses a compiled vocabulary as is, e.g. VocabFile::View(GetFrozenVocab()) for the one linked into the binary.
+	 * There is no json file behind it, so nothing is ever saved.
+	 */
+	explicit SolutionFile(VocabFile &&compiled);
 
-	size_t GetId(const std::string &token) const;
+	[[nodiscard]] const VocabFile &GetVocab() const { return vocab_; }
+
+	[[nodiscard]] const MatchTrie &GetMatcher() const { return matcher_; }
+	[[nodiscard]] size_t GetMaxLen() const { return vocab_.GetMaxLen(); }
+
+	/**
+	 * @return The narrowest id type every id of this vocabulary fits in, kUnknown included
+	 */
+	[[nodiscard]] IdWidth GetIdWidth() const { return vocab_.size() < kUnknown <uint16_t> ? ID16 : ID32; }
+	/**
+	 * Calls f(Id()) with the id type chosen by GetIdWidth, so callers write their output code once as a template
+	 */
+	template <class F>
+	decltype(auto) WithIdType(F &&f) const {
+		if (GetIdWidth() == ID16) return f(uint16_t());
+		return f(uint32_t());
+	}
+
+	/**
+	 * Looks a token up in the perfect hash index, verifying it against the string table
+	 * @return The id of the token, or -1 if it isn't in the vocabulary
+	 */
+	size_t GetId(std::string_view token) const;
+	/**
+	 * @return The id each token had when the vocabulary was first saved, empty if it was never renumbered
+	 */
+	[[nodiscard]] std::span <const uint32_t> GetOrder() const { return vocab_.GetOrder(); }
+
+	/**
+	 * Renumbers the tokens by how often greedy tokenization of a sample corpus uses them, most frequent first.
+	 * Hot tokens then share cache lines in id-indexed tables and get the shortest varint codes.
+	 * The json and binary files are rewritten, with the permutation to the original ids stored under "order".
+	 * @note Drops the word and document caches, whose ids would be stale. Not to be called while tokenizing.
+	 */
+	void RenumberByFrequency(const std::vector <std::string_view> &docs, ThreadPool &pool);
+
+	/**
+	 * Memoizes the tokens of repeated words in greedy mode, shared by every thread tokenizing with this object.
+	 * Results don't change: a word is only cached when no token can cross the delimiter after it.
+	 * @param capacity The most words kept. The least recently used are replaced first.
+	 * @note Not to be called while other threads are tokenizing
+	 */
+	void EnableWordCache(size_t capacity = 1 << 18);
+	void DisableWordCache();
+	/**
+	 * @return Hits, misses and evictions since the cache was enabled, all zero if it isn't
+	 */
+	[[nodiscard]] WordCache::Stats GetWordCacheStats() const;
+	/**
+	 * Remembers the ids of whole documents, so an exact duplicate is answered after hashing it once.
+	 * Used by the id-only Tokenize overloads, and so by TokenizeBatch.
+	 * @param max_bytes Memory the cache may take. The least recently used documents are evicted past it.
+	 * @note Not to be called while other threads are tokenizing
+	 */
+	void EnableDocumentCache(size_t max_bytes = 256 << 20);
+	void DisableDocumentCache();
+	/**
+	 * Skips the document cache without dropping it, e.g. to measure it or while it would only churn.
+	 * Safe to call at any time.
+	 */
+	void BypassDocumentCache(bool bypass);
+	/**
+	 * @return Hits, misses, evictions and memory use since the cache was enabled, all zero if it isn't
+	 */
+	[[nodiscard]] DocumentCache::Stats GetDocumentCacheStats() const;
 	const char *GetToken(size_t id) const;
 
-	std::vector <size_t> Tokenize(std::string input) const;
+	std::vector <size_t> Tokenize(std::string_view input) const;
+	/**
+	 * Tokenizes into a caller-owned buffer without allocating, folding case on the fly
+	 * @param out Receives the ids, starting with kStartId and ending with kEndId. Unknown bytes get kUnknown.
+	 *		uint16_t ids are only valid when GetIdWidth is ID16.
+	 * @param mode GREEDY matches the vocabulary training; OPTIMAL and HYBRID give fewer tokens,
+	 *		but allocate their dynamic programming tables
+	 * @return The number of ids in the full tokenization, at most input.size() + 2.
+	 *		If it is larger than out.size(), only the first out.size() ids were written.
+	 */
+	template <TokenId Id>
+	size_t Tokenize(std::string_view input, std::span <Id> out, Segmentation mode = GREEDY) const;
+	/**
+	 * As above, with the working buffers of the dynamic programming modes and the word cache kept by the caller,
+	 * so repeated calls allocate nothing once they have grown. TokenizerSession bundles them with the output.
+	 */
+	template <TokenId Id>
+	size_t Tokenize(std::string_view input, std::span <Id> out, SegmentScratch &scratch,
+	                Segmentation mode = GREEDY) const;
+	/**
+	 * Tokenizes into a reusable vector, replacing its contents. No allocation happens once its capacity suffices.
+	 */
+	template <TokenId Id>
+	void Tokenize(std::string_view input, std::vector <Id> &out, Segmentation mode = GREEDY) const;
+	/**
+	 * Tokenizes while recording which bytes of the input each token covers, in the same pass.
+	 * Case folding keeps byte positions, so the ranges index the original input directly.
+	 * @param ranges Receives one range per id. <START> covers [0, 0) and <END> covers [size, size).
+	 * @return The number of ids, as above. Ids and ranges are written up to the smaller of both spans.
+	 */
+	template <TokenId Id>
+	size_t Tokenize(std::string_view input, std::span <Id> out, std::span <ByteRange> ranges,
+	                Segmentation mode = GREEDY) const;
+	template <TokenId Id>
+	size_t Tokenize(std::string_view input, std::span <Id> out, std::span <ByteRange> ranges, SegmentScratch &scratch,
+	                Segmentation mode = GREEDY) const;
+	template <TokenId Id>
+	void Tokenize(std::string_view input, std::vector <Id> &out, std::vector <ByteRange> &ranges,
+	              Segmentation mode = GREEDY) const;
+	/**
+	 * Tokenizes many documents on a thread pool. The work is split into chunks of similar byte count,
+	 * and each document gets the same ids Tokenize would give it.
+	 */
+	template <TokenId Id = uint32_t>
+	TokenizedBatch <Id> TokenizeBatch(const std::vector <std::string_view> &docs, ThreadPool &pool) const;
+	/**
+	 * Tokenizes one large document on a thread pool, with the same result as Tokenize.
+	 * The input is cut near whitespace and the segments are tokenized speculatively. Each segment is then stitched
+	 * to the previous one at the first token boundary both agree on, re-tokenizing the gap sequentially if needed.
+	 */
+	template <TokenId Id>
+	void TokenizeParallel(std::string_view input, std::vector <Id> &out, ThreadPool &pool) const;
+
+	/**
+	 * Number of tokens Tokenize would give, without the <START> and <END> markers, computed without storing ids
+	 */
+	size_t CountTokens(std::string_view input, Segmentation mode = GREEDY) const;
+	size_t CountTokens(std::string_view input, SegmentScratch &scratch, Segmentation mode = GREEDY) const;
+	/**
+	 * Counts the tokens of many documents on a thread pool, split like TokenizeBatch
+	 */
+	TokenCounts CountTokensBatch(const std::vector <std::string_view> &docs, ThreadPool &pool,
+	                             Segmentation mode = GREEDY) const;
+	/**
+	 * Concatenates the tokens of ids. The text is sized first, so it is allocated once and filled with memcpy.
+	 */
 	std::string Detokenize(const std::vector <size_t> &ids) const;
+	template <TokenId Id>
+	std::string Detokenize(std::span <const Id> ids) const;
+	/**
+	 * Detokenizes into a reusable string, replacing its contents. No allocation happens once its capacity suffices.
+	 */
+	template <TokenId Id>
+	void Detokenize(std::span <const Id> ids, std::string &text) const;
+	/**
+	 * Writes the tokens of ids to a stream, through a fixed buffer instead of building the whole text
+	 * @return Whether the stream is still good
+	 */
+	template <TokenId Id>
+	bool Detokenize(std::span <const Id> ids, std::ostream &out) const;
+	/**
+	 * Writes the tokens of ids straight to a file descriptor, like the stream variant
+	 * @return Whether everything was written
+	 */
+	template <TokenId Id>
+	bool Detokenize(std::span <const Id> ids, int fd) const;
 
 	std::string Prettify (const std::vector <size_t> &ids) const;
 };
@@ -0,0 +1,42 @@
+#include "TokenizerSession.h"
+
+template <TokenId Id>
+void TokenizerSession <Id>::Reserve(const size_t size) {
+	scratch_.folded.reserve(size);
+	scratch_.cost.reserve(size + 1);
+	scratch_.id.reserve(size + 1);
+	scratch_.len.reserve(size + 1);
+	if (ids_.size() < size + 2) ids_.resize(size + 2);
+	if (ranges_.size() < size + 2) ranges_.resize(size + 2);
+}
+
+template <TokenId Id>
+std::span <const Id> TokenizerSession <Id>::Tokenize(const std::string_view input, const Segmentation mode) {
+	// Never shrunk, so a shorter input doesn't pay to clear what a longer one grew
+	if (ids_.size() < input.size() + 2) ids_.resize(input.size() + 2);
+	const size_t cnt = tkn_.Tokenize(input, std::span <Id>(ids_), scratch_, mode);
+	return {ids_.data(), cnt};
+}
+
+template <TokenId Id>
+std::span <const Id> TokenizerSession <Id>::TokenizeWithRanges(const std::string_view input,
+                                                               const Segmentation mode) {
+	if (ids_.size() < input.size() + 2) ids_.resize(input.size() + 2);
+	if (ranges_.size() < input.size() + 2) ranges_.resize(input.size() + 2);
+	range_cnt_ = tkn_.Tokenize(input, std::span <Id>(ids_), std::span(ranges_), scratch_, mode);
+	return {ids_.data(), range_cnt_};
+}
+
+template <TokenId Id>
+size_t TokenizerSession <Id>::CountTokens(const std::string_view input, const Segmentation mode) {
+	return tkn_.CountTokens(input, scratch_, mode);
+}
+
+template <TokenId Id>
+std::string_view TokenizerSession <Id>::Detokenize(const std::span <const Id> ids) {
+	tkn_.Detokenize(ids, text_);
+	return text_;
+}
+
+template class TokenizerSession <uint16_t>;
+template class TokenizerSession <uint32_t>;
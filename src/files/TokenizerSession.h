@@ -0,0 +1,54 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "SolutionFile.h"
+#include "../encoder/Segmenter.h"
+#include "../encoder/TokenId.h"
+
+/**
+ * Working memory of one thread tokenizing with a SolutionFile: the case folded input, the dynamic programming
+ * tables, the ids, the byte ranges and the detokenized text. Each buffer only ever grows, so once a session
+ * has seen its largest input, tokenizing allocates nothing (except to fill a document cache, if one is on).
+ * Results point into the session and stay valid until its next call of the same kind.
+ * @note Not thread safe. Keep one per worker thread, e.g. thread_local.
+ */
+template <TokenId Id = uint32_t>
+class TokenizerSession {
+	const SolutionFile &tkn_;
+	SegmentScratch scratch_;
+	std::vector <Id> ids_;
+	std::vector <SolutionFile::ByteRange> ranges_;
+	size_t range_cnt_ = 0;
+	std::string text_;
+
+public:
+	explicit TokenizerSession(const SolutionFile &tkn) : tkn_(tkn) {}
+
+	[[nodiscard]] const SolutionFile &GetSolution() const { return tkn_; }
+
+	/**
+	 * Grows the buffers for inputs up to size bytes ahead of time, so not even the first calls allocate
+	 */
+	void Reserve(size_t size);
+
+	/**
+	 * @return The ids of input, from kStartId to kEndId, as SolutionFile::Tokenize gives them
+	 */
+	std::span <const Id> Tokenize(std::string_view input, Segmentation mode = GREEDY);
+	/**
+	 * Tokenizes while recording the bytes of input each token covers, retrieved with GetRanges
+	 */
+	std::span <const Id> TokenizeWithRanges(std::string_view input, Segmentation mode = GREEDY);
+	/**
+	 * @return The ranges of the last TokenizeWithRanges, one per id
+	 */
+	[[nodiscard]] std::span <const SolutionFile::ByteRange> GetRanges() const { return {ranges_.data(), range_cnt_}; }
+
+	size_t CountTokens(std::string_view input, Segmentation mode = GREEDY);
+
+	std::string_view Detokenize(std::span <const Id> ids);
+};
@@ -0,0 +1,254 @@
+#include "VocabFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../config.h"
+
+constexpr char kMagic[8] = {'T', 'K', 'N', 'V', 'O', 'C', 'A', 'B'};
+// Bump whenever the layout below changes so stale images get rebuilt from the json file
+constexpr uint32_t kFormat = 4;
+constexpr uint32_t kByteOrder = 0x01020304;
+
+struct VocabFile::Header {
+	char magic[8];
+	uint32_t format;
+	uint32_t byte_order;
+	char version[16];
+	uint32_t token_cnt;
+	uint32_t max_len;
+	uint64_t offsets_pos;
+	uint64_t blob_pos;
+	uint64_t blob_size;
+	uint64_t units_pos;
+	uint64_t unit_cnt;
+	uint64_t hash_seed;
+	uint64_t displace_pos;
+	uint64_t bucket_cnt;
+	uint64_t slots_pos;
+	uint64_t slot_cnt;
+	uint64_t order_pos;
+	uint64_t order_cnt;
+	uint64_t source_size;
+	int64_t source_mtime_ns;
+};
+
+size_t Align(const size_t pos) {
+	return (pos + 7) & ~(size_t)7;
+}
+
+// Whether cnt items of item_size bytes starting at pos, aligned for them, lie within size bytes, without overflowing
+bool InBounds(const uint64_t pos, const uint64_t cnt, const size_t item_size, const size_t align, const size_t size) {
+	return pos % align == 0 && pos <= size && cnt <= (size - pos) / item_size;
+}
+
+// Every id in the table is a token, or kNoId where that is allowed
+bool IdsValid(const std::span <const uint32_t> ids, const size_t token_cnt, const bool allow_none) {
+	return std::ranges::all_of(ids, [token_cnt, allow_none](const uint32_t id) {
+		return id < token_cnt || (allow_none && id == PerfectHash::kNoId);
+	});
+}
+
+// The image may be truncated or corrupted, so everything the accessors index without checks is checked here once
+bool VocabFile::Validate() {
+	if (data_ == nullptr || size_ < sizeof(Header)) return false;
+	if ((uintptr_t)data_ % alignof(Header) != 0) return false;
+	const auto *header = (const Header *)data_;
+	if (memcmp(header->magic, kMagic, sizeof kMagic) != 0) return false;
+	if (header->format != kFormat) return false;
+	if (header->byte_order != kByteOrder) return false;
+	if (strncmp(header->version, kBuildVersion.c_str(), sizeof header->version) != 0) return false;
+
+	const uint64_t token_cnt = header->token_cnt;
+	if (!InBounds(header->offsets_pos, token_cnt + 1, sizeof(uint32_t), alignof(uint32_t), size_)) return false;
+	if (!InBounds(header->blob_pos, header->blob_size, 1, 1, size_)) return false;
+	if (!InBounds(header->units_pos, header->unit_cnt, sizeof(MatchTrie::Unit), alignof(MatchTrie::Unit), size_)) {
+		return false;
+	}
+	if (!InBounds(header->displace_pos, header->bucket_cnt, sizeof(uint16_t), alignof(uint16_t), size_)) return false;
+	if (!InBounds(header->slots_pos, header->slot_cnt, sizeof(uint32_t), alignof(uint32_t), size_)) return false;
+	if ((header->bucket_cnt == 0) != (header->slot_cnt == 0)) return false;
+	if (!InBounds(header->order_pos, header->order_cnt, sizeof(uint32_t), alignof(uint32_t), size_)) return false;
+	if (header->order_cnt != 0 && header->order_cnt != token_cnt) return false;
+
+	offsets_ = (const uint32_t *)(data_ + header->offsets_pos);
+	blob_ = data_ + header->blob_pos;
+	units_ = (const MatchTrie::Unit *)(data_ + header->units_pos);
+	displace_ = (const uint16_t *)(data_ + header->displace_pos);
+	slots_ = (const uint32_t *)(data_ + header->slots_pos);
+	order_ = (const uint32_t *)(data_ + header->order_pos);
+
+	// Each token ends with its '\0' inside the blob, so GetToken never reads outside it
+	if (offsets_[0] != 0 || offsets_[token_cnt] != header->blob_size) return false;
+	size_t max_len = 0;
+	for (size_t id = 0; id < token_cnt; id++) {
+		if (offsets_[id] >= offsets_[id + 1] || offsets_[id + 1] > header->blob_size) return false;
+		if (blob_[offsets_[id + 1] - 1] != '\0') return false;
+		max_len = std::max(max_len, (size_t)(offsets_[id + 1] - offsets_[id] - 1));
+	}
+	if (header->max_len > max_len) return false;
+	if (!MatchTrie::IsValid({units_, header->unit_cnt}, token_cnt)) return false;
+	if (!IdsValid({slots_, header->slot_cnt}, token_cnt, true)) return false;
+	if (!IdsValid({order_, header->order_cnt}, token_cnt, false)) return false;
+
+	source_ = {header->source_size, header->source_mtime_ns};
+	unit_cnt_ = header->unit_cnt;
+	hash_seed_ = header->hash_seed;
+	bucket_cnt_ = header->bucket_cnt;
+	slot_cnt_ = header->slot_cnt;
+	order_cnt_ = header->order_cnt;
+	token_cnt_ = token_cnt;
+	max_len_ = header->max_len;
+	return true;
+}
+
+void VocabFile::Unmap() {
+	if (map_ != nullptr) munmap(map_, map_size_);
+	map_ = nullptr;
+	map_size_ = 0;
+}
+
+VocabFile::VocabFile(const std::string &path) {
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1) return;
+	struct stat info {};
+	if (fstat(fd, &info) == 0 && info.st_size > 0) {
+		void *map = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map != MAP_FAILED) {
+			map_ = map;
+			map_size_ = info.st_size;
+		}
+	}
+	close(fd);
+
+	data_ = (const char *)map_;
+	size_ = map_size_;
+	valid_ = Validate();
+}
+VocabFile::VocabFile(std::vector <char> &&image) :
+	owned_(std::move(image)) {
+	data_ = owned_.data();
+	size_ = owned_.size();
+	valid_ = Validate();
+}
+VocabFile::VocabFile(VocabFile &&other) noexcept {
+	*this = std::move(other);
+}
+VocabFile &VocabFile::operator=(VocabFile &&other) noexcept {
+	if (this == &other) return *this;
+	Unmap();
+	owned_ = std::move(other.owned_);
+	map_ = std::exchange(other.map_, nullptr);
+	map_size_ = std::exchange(other.map_size_, 0);
+	data_ = std::exchange(other.data_, nullptr);
+	size_ = std::exchange(other.size_, 0);
+	valid_ = std::exchange(other.valid_, false);
+	offsets_ = std::exchange(other.offsets_, nullptr);
+	blob_ = std::exchange(other.blob_, nullptr);
+	units_ = std::exchange(other.units_, nullptr);
+	unit_cnt_ = std::exchange(other.unit_cnt_, 0);
+	hash_seed_ = std::exchange(other.hash_seed_, 0);
+	displace_ = std::exchange(other.displace_, nullptr);
+	bucket_cnt_ = std::exchange(other.bucket_cnt_, 0);
+	slots_ = std::exchange(other.slots_, nullptr);
+	slot_cnt_ = std::exchange(other.slot_cnt_, 0);
+	order_ = std::exchange(other.order_, nullptr);
+	order_cnt_ = std::exchange(other.order_cnt_, 0);
+	token_cnt_ = std::exchange(other.token_cnt_, 0);
+	max_len_ = std::exchange(other.max_len_, 0);
+	source_ = std::exchange(other.source_, {});
+	return *this;
+}
+VocabFile::~VocabFile() {
+	Unmap();
+}
+
+std::vector <char> VocabFile::Build(const std::vector <std::string_view> &tokens, const size_t first_text_id,
+                                    const std::span <const uint32_t> order) {
+	Header header {};
+	memcpy(header.magic, kMagic, sizeof kMagic);
+	header.format = kFormat;
+	header.byte_order = kByteOrder;
+	strncpy(header.version, kBuildVersion.c_str(), sizeof header.version - 1);
+	header.token_cnt = tokens.size();
+
+	std::vector <uint32_t> offsets;
+	offsets.reserve(tokens.size() + 1);
+	std::string blob;
+	std::vector <std::pair <std::string_view, uint32_t>> keys;
+	keys.reserve(tokens.size());
+	for (size_t id = 0; id < tokens.size(); id++) {
+		offsets.push_back(blob.size());
+		blob += tokens[id];
+		blob += '\0';
+		if (id < first_text_id) continue;
+		keys.emplace_back(tokens[id], id);
+		header.max_len = std::max(header.max_len, (uint32_t)tokens[id].size());
+	}
+	offsets.push_back(blob.size());
+	const PerfectHash::Table index = PerfectHash::Build(keys);
+	const std::vector <MatchTrie::Unit> units = MatchTrie::Build(std::move(keys));
+
+	header.offsets_pos = Align(sizeof header);
+	header.blob_pos = Align(header.offsets_pos + sizeof(uint32_t) * offsets.size());
+	header.blob_size = blob.size();
+	header.units_pos = Align(header.blob_pos + blob.size());
+	header.unit_cnt = units.size();
+	header.hash_seed = index.seed;
+	header.displace_pos = Align(header.units_pos + sizeof(MatchTrie::Unit) * units.size());
+	header.bucket_cnt = index.displace.size();
+	header.slots_pos = Align(header.displace_pos + sizeof(uint16_t) * index.displace.size());
+	header.slot_cnt = index.slots.size();
+	header.order_pos = Align(header.slots_pos + sizeof(uint32_t) * index.slots.size());
+	header.order_cnt = order.size();
+
+	std::vector <char> image(header.order_pos + sizeof(uint32_t) * order.size());
+	memcpy(image.data(), &header, sizeof header);
+	memcpy(image.data() + header.offsets_pos, offsets.data(), sizeof(uint32_t) * offsets.size());
+	memcpy(image.data() + header.blob_pos, blob.data(), blob.size());
+	memcpy(image.data() + header.units_pos, units.data(), sizeof(MatchTrie::Unit) * units.size());
+	memcpy(image.data() + header.displace_pos, index.displace.data(), sizeof(uint16_t) * index.displace.size());
+	memcpy(image.data() + header.slots_pos, index.slots.data(), sizeof(uint32_t) * index.slots.size());
+	memcpy(image.data() + header.order_pos, order.data(), sizeof(uint32_t) * order.size());
+	return image;
+}
+
+VocabFile VocabFile::View(const std::span <const char> image) {
+	VocabFile vocab;
+	vocab.data_ = image.data();
+	vocab.size_ = image.size();
+	vocab.valid_ = vocab.Validate();
+	return vocab;
+}
+
+std::optional <VocabFile::Source> VocabFile::Source::Of(const std::string &path) {
+	struct stat info {};
+	if (stat(path.c_str(), &info) != 0) return std::nullopt;
+	return Source {(uint64_t)info.st_size, (int64_t)info.st_mtim.tv_sec * 1'000'000'000 + info.st_mtim.tv_nsec};
+}
+
+bool VocabFile::Save(const std::string &path, const Source &source) const {
+	if (!valid_) return false;
+	Header header;
+	memcpy(&header, data_, sizeof header);
+	header.source_size = source.size;
+	header.source_mtime_ns = source.mtime_ns;
+	const std::string tmp_path = path + ".tmp";
+	{
+		std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+		out.write((const char *)&header, sizeof header);
+		out.write(data_ + sizeof header, (std::streamsize)(size_ - sizeof header));
+		if (!out.good()) return false;
+	}
+	std::error_code err;
+	std::filesystem::rename(tmp_path, path, err);
+	return !err;
+}
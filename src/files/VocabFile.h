@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../encoder/MatchTrie.h"
+#include "../encoder/PerfectHash.h"
+
+/**
+ * Compiled vocabulary (.tokens.bin): a string table, its offsets, the prebuilt matcher units, a perfect hash
+ * of the tokens and the permutation of ids renumbering applied, if any.
+ * The image is used in place, so a mapped file loads without parsing and its pages are shared between processes.
+ * Loading checks every offset, unit and id once, so a truncated or corrupted file is rejected instead of read.
+ */
+class VocabFile {
+public:
+	/**
+	 * Size and modification time of the file a vocabulary was compiled from. The compiled copy is current only while
+	 * they match exactly: a file replaced by an older copy has a different time without having a newer one.
+	 */
+	struct Source {
+		uint64_t size = 0;
+		int64_t mtime_ns = 0;
+
+		bool operator==(const Source &) const = default;
+		/**
+		 * @return The stamp of the file at path, or nullopt if it can't be read
+		 */
+		static std::optional <Source> Of(const std::string &path);
+	};
+
+private:
+	struct Header;
+
+	std::vector <char> owned_;
+	void *map_ = nullptr;
+	size_t map_size_ = 0;
+
+	const char *data_ = nullptr;
+	size_t size_ = 0;
+	bool valid_ = false;
+
+	const uint32_t *offsets_ = nullptr;
+	const char *blob_ = nullptr;
+	const MatchTrie::Unit *units_ = nullptr;
+	size_t unit_cnt_ = 0;
+	uint64_t hash_seed_ = 0;
+	const uint16_t *displace_ = nullptr;
+	size_t bucket_cnt_ = 0;
+	const uint32_t *slots_ = nullptr;
+	size_t slot_cnt_ = 0;
+	const uint32_t *order_ = nullptr;
+	size_t order_cnt_ = 0;
+	size_t token_cnt_ = 0;
+	size_t max_len_ = 0;
+	Source source_;
+
+	bool Validate();
+	void Unmap();
+
+public:
+	VocabFile() = default;
+	/**
+	 * Maps a compiled vocabulary file read-only
+	 * @note If the file is missing, outdated or corrupted, the object is left invalid
+	 */
+	explicit VocabFile(const std::string &path);
+	/**
+	 * Takes ownership of an image produced by Build
+	 */
+	explicit VocabFile(std::vector <char> &&image);
+	VocabFile(VocabFile &&other) noexcept;
+	VocabFile &operator=(VocabFile &&other) noexcept;
+	~VocabFile();
+
+	/**
+	 * Compiles a vocabulary into its binary image
+	 * @param tokens All tokens, indexed by id
+	 * @param first_text_id Tokens before this id are control tokens and never matched in text
+	 * @param order The original id of each token, if they were renumbered. Empty when ids are original.
+	 */
+	static std::vector <char> Build(const std::vector <std::string_view> &tokens, size_t first_text_id,
+	                                std::span <const uint32_t> order = {});
+	/**
+	 * Views an image that outlives the object, such as one compiled into the binary
+	 * @note The image must be 8 byte aligned
+	 */
+	static VocabFile View(std::span <const char> image);
+	/**
+	 * Writes the image to disk, replacing any previous file atomically
+	 * @param source Recorded in the file, for GetSource when it is loaded again
+	 */
+	bool Save(const std::string &path, const Source &source) const;
+
+	[[nodiscard]] bool IsValid() const { return valid_; }
+	[[nodiscard]] std::span <const char> GetImage() const { return {data_, size_}; }
+
+	[[nodiscard]] size_t size() const { return token_cnt_; }
+	[[nodiscard]] size_t GetMaxLen() const { return max_len_; }
+	[[nodiscard]] const Source &GetSource() const { return source_; }
+
+	/**
+	 * @return The bytes of a token. They are always followed by a '\0'.
+	 */
+	[[nodiscard]] std::string_view GetToken(const size_t id) const {
+		return {blob_ + offsets_[id], offsets_[id + 1] - offsets_[id] - 1};
+	}
+	[[nodiscard]] MatchTrie GetMatcher() const { return {{units_, unit_cnt_}, max_len_}; }
+	[[nodiscard]] std::span <const uint32_t> GetOrder() const { return {order_, order_cnt_}; }
+	[[nodiscard]] PerfectHash GetIndex() const { return {hash_seed_, {displace_, bucket_cnt_}, {slots_, slot_cnt_}}; }
+};
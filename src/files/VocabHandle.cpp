@@ -0,0 +1,46 @@
+#include "VocabHandle.h"
+
+#include <thread>
+
+// Slot of the calling thread, handed out round robin so the first kSlots threads get one each
+size_t ThreadSlot() {
+	static std::atomic <size_t> next_slot = 0;
+	thread_local const size_t slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+	return slot;
+}
+
+VocabHandle::VocabHandle(std::unique_ptr <SolutionFile> tkn) :
+	current_(tkn.release()) {}
+VocabHandle::~VocabHandle() {
+	delete current_.load();
+}
+
+VocabHandle::Reader VocabHandle::Read() const {
+	std::atomic <int64_t> &count = slots_[ThreadSlot() % kSlots].readers[epoch_.load() & 1];
+	// Sequentially consistent, so a swap either sees this reader or this reader sees the swapped in pointer
+	count.fetch_add(1);
+	return {current_.load(), &count};
+}
+
+void VocabHandle::Synchronize() {
+	for (size_t flip = 0; flip < 2; flip++) {
+		const uint64_t old_parity = epoch_.fetch_add(1) & 1;
+		for (const Slot &slot : slots_) {
+			while (slot.readers[old_parity].load() != 0) std::this_thread::yield();
+		}
+	}
+}
+
+void VocabHandle::Swap(std::unique_ptr <SolutionFile> tkn) {
+	std::lock_guard lock(swap_mutex_);
+	const SolutionFile *old = current_.exchange(tkn.release());
+	Synchronize();
+	delete old;
+}
+
+bool VocabHandle::Reload(const std::string &path) {
+	auto tkn = std::make_unique <SolutionFile>(path);
+	if (!tkn->GetVocab().IsValid()) return false;
+	Swap(std::move(tkn));
+	return true;
+}
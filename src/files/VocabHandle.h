@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "SolutionFile.h"
+
+/**
+ * Shares a vocabulary between threads while letting it be replaced under load.
+ * Readers pin the current SolutionFile for the duration of a call; Swap publishes a new one at once and destroys
+ * the old one only after every reader that could still see it has finished, in the manner of sleepable RCU.
+ *
+ * Readers count themselves into one of two counters, picked by the parity of the epoch they entered in.
+ * The counters are spread over cache lines by thread, so concurrent readers rarely touch the same line.
+ * Swap flips the epoch and waits for the counters of the old parity to drain, twice, which covers readers
+ * that read the epoch just before a flip.
+ */
+class VocabHandle {
+	static constexpr size_t kSlots = 32;
+	struct alignas(64) Slot {
+		std::array <std::atomic <int64_t>, 2> readers {};
+	};
+
+	std::atomic <SolutionFile *> current_;
+	std::atomic <uint64_t> epoch_ = 0;
+	mutable std::array <Slot, kSlots> slots_;
+	std::mutex swap_mutex_;
+
+	// Waits until no reader is left that entered before the call
+	void Synchronize();
+
+public:
+	/**
+	 * Keeps a vocabulary pinned while it lives. Hold it for one call or one batch, not indefinitely:
+	 * a swap waits for it.
+	 */
+	class Reader {
+		const SolutionFile *tkn_;
+		std::atomic <int64_t> *count_;
+
+	public:
+		Reader(const SolutionFile *tkn, std::atomic <int64_t> *count) : tkn_(tkn), count_(count) {}
+		Reader(Reader &&other) noexcept : tkn_(other.tkn_), count_(std::exchange(other.count_, nullptr)) {}
+		Reader(const Reader &) = delete;
+		Reader &operator=(const Reader &) = delete;
+		~Reader() { if (count_ != nullptr) count_->fetch_sub(1, std::memory_order_release); }
+
+		const SolutionFile &operator*() const { return *tkn_; }
+		const SolutionFile *operator->() const { return tkn_; }
+	};
+
+	explicit VocabHandle(std::unique_ptr <SolutionFile> tkn);
+	VocabHandle(const VocabHandle &) = delete;
+	VocabHandle &operator=(const VocabHandle &) = delete;
+	/**
+	 * @note No reader may be left
+	 */
+	~VocabHandle();
+
+	/**
+	 * Pins the current vocabulary. Costs one atomic increment on a counter mostly private to the thread.
+	 */
+	[[nodiscard]] Reader Read() const;
+
+	/**
+	 * Publishes a vocabulary for all later reads, then waits for the reads still using the previous one and
+	 * destroys it. Concurrent swaps are serialized.
+	 * @note A thread holding a Reader must not call it, it would wait for itself
+	 */
+	void Swap(std::unique_ptr <SolutionFile> tkn);
+	/**
+	 * Loads a vocabulary off to the side, so readers keep full speed meanwhile, then swaps it in
+	 * @return False if it doesn't load, in which case the current vocabulary stays
+	 */
+	bool Reload(const std::string &path);
+	/**
+	 * @return How many swaps were made, for telling vocabularies apart in logs
+	 */
+	[[nodiscard]] uint64_t GetGeneration() const { return epoch_.load(std::memory_order_relaxed) / 2; }
+};
@@ -1,8 +1,21 @@
+#include <atomic>
+#include <csignal>
+#include <cstring>
 #include <iostream>
+#include <thread>
 
+#include <pthread.h>
+
+#include "check/SimdCheck.h"
+#include "check/TokenizeCheck.h"
 #include "files/DataFile.h"
+#include "files/DatasetWriter.h"
+#include "files/FrozenVocab.h"
 #include "files/MetadataFile.h"
 #include "files/SolutionFile.h"
+#include "files/VocabHandle.h"
+#include "server/RingServer.h"
+#include "server/TokenServer.h"
 #include "tokenizer/GetTokens.h"
 #include "tokenizer/TokenGenerator.h"
 #include "utils/Multithread.h"
@@ -11,9 +24,145 @@
 
 const std::string kDataPath = "../../Input Data/Raw Text/test";
 
-int main() {
+template <class Server>
+Server *serving = nullptr;
+
+// Runs a server until SIGINT or SIGTERM
+template <class Server>
+void RunUntilSignal(Server &server) {
+	serving <Server> = &server;
+	const auto stop = [](int) { serving <Server>->Stop(); };
+	std::signal(SIGINT, stop);
+	std::signal(SIGTERM, stop);
+	server.Run();
+	std::signal(SIGINT, SIG_DFL);
+	std::signal(SIGTERM, SIG_DFL);
+	serving <Server> = nullptr;
+}
+
+int Serve(VocabHandle &vocab, const std::string &address, const bool shared_memory) {
+	ThreadPool pool;
+	if (shared_memory) {
+		RingServer server(vocab, pool);
+		if (!server.Create(address)) {
+			std::cerr << "Cannot create shared memory " << address << ": " << strerror(errno) << std::endl;
+			return 1;
+		}
+		std::cout << "Serving on shared memory " << address << std::endl;
+		RunUntilSignal(server);
+		return 0;
+	}
+	TokenServer server(vocab, pool);
+	if (!server.Listen(address)) {
+		std::cerr << "Cannot listen on " << address << ": " << strerror(errno) << std::endl;
+		return 1;
+	}
+	std::cout << "Serving on " << address << std::endl;
+	RunUntilSignal(server);
+	std::cout << server.FormatStats();
+	return 0;
+}
+
+// Serves a vocabulary file, reloading it on SIGHUP without dropping a request
+int ServeReloading(const std::string &path, const std::string &address, const bool shared_memory) {
+	// Blocked before any thread starts, so only the reloader ever receives it
+	sigset_t hangup;
+	sigemptyset(&hangup);
+	sigaddset(&hangup, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &hangup, nullptr);
+
+	VocabHandle vocab(std::make_unique <SolutionFile>(path));
+	std::atomic <bool> stopping = false;
+	std::thread reloader([&] {
+		int received;
+		while (sigwait(&hangup, &received) == 0 && !stopping) {
+			if (vocab.Reload(path)) std::cout << "Reloaded " << path << ", generation " << vocab.GetGeneration() << std::endl;
+			else std::cerr << "Cannot reload " << path << ", keeping the current vocabulary" << std::endl;
+		}
+	});
+	const int status = Serve(vocab, address, shared_memory);
+	stopping = true;
+	pthread_kill(reloader.native_handle(), SIGHUP);
+	reloader.join();
+	return status;
+}
+
+int main(const int argc, char **argv) {
+	if (argc >= 2 && (strcmp(argv[1], "serve") == 0 || strcmp(argv[1], "serve-shm") == 0)) {
+		if (argc < 3 || argc > 4) {
+			std::cerr << "Usage: " << argv[0] << " serve <socket path> [.tokens.json]\n";
+			std::cerr << "       " << argv[0] << " serve-shm </shared memory name> [.tokens.json]" << std::endl;
+			return 2;
+		}
+		const bool shared_memory = strcmp(argv[1], "serve-shm") == 0;
+		if (argc == 4) return ServeReloading(argv[3], argv[2], shared_memory);
+#if defined(TOKENIZER_FROZEN_VOCAB)
+		VocabHandle frozen(std::make_unique <SolutionFile>(VocabFile::View(GetFrozenVocab())));
+		return Serve(frozen, argv[2], shared_memory);
+#else
+		return ServeReloading(kDataPath + "/.tokens.json", argv[2], shared_memory);
+#endif
+	}
+
+	if (argc >= 2 && strcmp(argv[1], "check-simd") == 0) {
+		if (argc != 2) {
+			std::cerr << "Usage: " << argv[0] << " check-simd" << std::endl;
+			return 2;
+		}
+		return CheckSimdKernels() ? 0 : 1;
+	}
+
+	if (argc >= 2 && strcmp(argv[1], "check-tokenize") == 0) {
+		if (argc > 3) {
+			std::cerr << "Usage: " << argv[0] << " check-tokenize [.tokens.json]" << std::endl;
+			return 2;
+		}
+		const MetadataFile metadata(kDataPath + "/.metadata.json");
+#if defined(TOKENIZER_FROZEN_VOCAB)
+		const std::unique_ptr <SolutionFile> tkn = argc == 3 ?
+			std::make_unique <SolutionFile>(argv[2]) :
+			std::make_unique <SolutionFile>(VocabFile::View(GetFrozenVocab()));
+#else
+		const auto tkn = std::make_unique <SolutionFile>(argc == 3 ? argv[2] : kDataPath + "/.tokens.json");
+#endif
+		std::vector <std::string> texts;
+		for (const MetadataFile::Entry &file : metadata.GetFiles()) {
+			DataFile data(metadata.GetRootPath() / file.path);
+			for (const DataFile::Entry &entry : data) {
+				texts.emplace_back(entry.text);
+			}
+		}
+		const std::vector <std::string_view> docs(texts.begin(), texts.end());
+		ThreadPool pool;
+		return CheckTokenize(*tkn, docs, pool) ? 0 : 1;
+	}
+
+	if (argc >= 2 && strcmp(argv[1], "dataset") == 0) {
+		if (argc < 3 || argc > 4) {
+			std::cerr << "Usage: " << argv[0] << " dataset <output path> [.tokens.json]" << std::endl;
+			return 2;
+		}
+		const MetadataFile metadata(kDataPath + "/.metadata.json");
+#if defined(TOKENIZER_FROZEN_VOCAB)
+		const std::unique_ptr <SolutionFile> tkn = argc == 4 ?
+			std::make_unique <SolutionFile>(argv[3]) :
+			std::make_unique <SolutionFile>(VocabFile::View(GetFrozenVocab()));
+#else
+		const auto tkn = std::make_unique <SolutionFile>(argc == 4 ? argv[3] : kDataPath + "/.tokens.json");
+#endif
+		ThreadPool pool;
+		if (!WriteDataset(metadata, *tkn, argv[2], pool)) {
+			std::cerr << "Cannot write dataset " << argv[2] << ": " << strerror(errno) << std::endl;
+			return 1;
+		}
+		std::cout << "Wrote " << argv[2] << ".ids and " << argv[2] << ".idx" << std::endl;
+		return 0;
+	}
+
 	MetadataFile metadata(kDataPath + "/.metadata.json");
-#ifdef RUN_SIM
+#if defined(TOKENIZER_FROZEN_VOCAB)
+	SolutionFile tkn(VocabFile::View(GetFrozenVocab()));
+#elif defined(RUN_SIM)
 	std::vector <std::string> solution;
 	{
 		// TODO compare different batch sizes for different thread counts to see if a relation can be inferred
@@ -31,16 +180,19 @@ int main() {
 	{
 		std::string test_file = metadata.GetFiles().back().path;
 		std::cout << "Benchmark on file " << test_file << std::endl;
-		std::atomic <size_t> init_size = 0;
-		std::atomic <size_t> comp_size = 0;
 		DataFile test(metadata.GetRootPath() / test_file);
-		ThreadPool pool;
-		for (const DataFile::Entry &entry : test.GetEntries()) {
-			pool.Enqueue([text = entry.text, &tkn, &comp_size, &init_size] {
-				init_size += text.size();
-				comp_size += tkn.Tokenize(text).size() - 2;
-			});
+		std::vector <std::string> texts;
+		size_t init_size = 0;
+		for (const DataFile::Entry &entry : test) {
+			texts.emplace_back(entry.text);
+			init_size += entry.text.size();
 		}
+		const std::vector <std::string_view> docs(texts.begin(), texts.end());
+		ThreadPool pool;
+#ifdef RUN_SIM
+		tkn.RenumberByFrequency(docs, pool);
+#endif
+		const size_t comp_size = tkn.CountTokensBatch(docs, pool).total;
 		std::cout << init_size << " characters, " << comp_size << " tokens - compression factor ";
 		std::cout << (double)init_size / comp_size << std::endl;
 	}
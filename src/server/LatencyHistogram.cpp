@@ -0,0 +1,43 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+size_t LatencyHistogram::BucketOf(const uint64_t nanos) {
+	if (nanos < kSubBuckets) return nanos;
+	const size_t msb = std::bit_width(nanos) - 1;
+	return (msb - kSubBits + 1) * kSubBuckets + (nanos >> (msb - kSubBits) & (kSubBuckets - 1));
+}
+
+uint64_t LatencyHistogram::UpperBound(const size_t bucket) {
+	if (bucket < kSubBuckets) return bucket;
+	const size_t msb = bucket / kSubBuckets + kSubBits - 1;
+	const uint64_t sub = bucket % kSubBuckets;
+	const uint64_t lower = (uint64_t)1 << msb | sub << (msb - kSubBits);
+	return lower + (((uint64_t)1 << (msb - kSubBits)) - 1);
+}
+
+void LatencyHistogram::Record(const uint64_t nanos) {
+	buckets_[BucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	sum_.fetch_add(nanos, std::memory_order_relaxed);
+	if (nanos > max_.load(std::memory_order_relaxed)) max_.store(nanos, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::GetMean() const {
+	const uint64_t count = GetCount();
+	return count == 0 ? 0 : (double)sum_.load(std::memory_order_relaxed) / count;
+}
+
+uint64_t LatencyHistogram::GetPercentile(const double quantile) const {
+	const uint64_t count = GetCount();
+	if (count == 0) return 0;
+	const auto rank = std::max((uint64_t)std::ceil(std::clamp(quantile, 0.0, 1.0) * count), (uint64_t)1);
+	uint64_t seen = 0;
+	for (size_t bucket = 0; bucket < kBuckets; bucket++) {
+		seen += buckets_[bucket].load(std::memory_order_relaxed);
+		if (seen >= rank) return std::min(UpperBound(bucket), GetMax());
+	}
+	return GetMax();
+}
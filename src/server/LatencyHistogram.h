@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Log-linear histogram of durations in nanoseconds: every power of two is split into 8 buckets,
+ * so percentiles are within 12.5% of the true value over the whole range.
+ * One thread records, any thread may read concurrently.
+ */
+class LatencyHistogram {
+	static constexpr size_t kSubBits = 3;
+	static constexpr size_t kSubBuckets = 1 << kSubBits;
+	static constexpr size_t kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+	std::array <std::atomic <uint64_t>, kBuckets> buckets_ {};
+	std::atomic <uint64_t> count_ = 0;
+	std::atomic <uint64_t> sum_ = 0;
+	std::atomic <uint64_t> max_ = 0;
+
+	static size_t BucketOf(uint64_t nanos);
+	// The largest value falling in a bucket
+	static uint64_t UpperBound(size_t bucket);
+
+public:
+	void Record(uint64_t nanos);
+
+	[[nodiscard]] uint64_t GetCount() const { return count_.load(std::memory_order_relaxed); }
+	[[nodiscard]] uint64_t GetMax() const { return max_.load(std::memory_order_relaxed); }
+	[[nodiscard]] double GetMean() const;
+	/**
+	 * @param quantile In [0, 1], e.g. 0.99 for the 99th percentile
+	 * @return An upper bound of the duration, 0 if nothing was recorded
+	 */
+	[[nodiscard]] uint64_t GetPercentile(double quantile) const;
+};
@@ -0,0 +1,134 @@
+#include "RingClient.h"
+
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// How long a client sleeps before checking the server is still up
+constexpr long kReplyWaitNs = 100'000'000;
+
+RingClient::RingClient(const std::string &name) {
+	const int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+	if (fd == -1) return;
+	struct stat info {};
+	void *map = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(ring::Header)) {
+		map = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED) return;
+
+	auto *header = (ring::Header *)map;
+	const bool valid = memcmp(header->magic, ring::kMagic, sizeof ring::kMagic) == 0 &&
+	                   header->format == ring::kFormat && header->slot_cnt != 0 &&
+	                   ring::RegionSize(header->slot_cnt, header->slot_bytes) <= (size_t)info.st_size &&
+	                   header->stopped.load() == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (!valid) {
+		munmap(map, info.st_size);
+		return;
+	}
+	header_ = header;
+	map_size_ = info.st_size;
+}
+RingClient::~RingClient() {
+	if (header_ != nullptr) munmap(header_, map_size_);
+}
+
+RingClient::Lease RingClient::Acquire() const {
+	const uint32_t slot_cnt = header_->slot_cnt;
+	const auto pid = (uint32_t)getpid();
+	while (header_->stopped.load() == 0) {
+		const uint32_t released = header_->released.load();
+		for (uint32_t tries = 0; tries < slot_cnt; tries++) {
+			ring::Slot &slot = ring::GetSlot(*header_, header_->next_slot.fetch_add(1) % slot_cnt);
+			uint32_t owner = 0;
+			if (slot.owner.compare_exchange_strong(owner, pid, std::memory_order_acquire)) {
+				slot.state.store(ring::CLAIMED, std::memory_order_relaxed);
+				return {*this, slot};
+			}
+		}
+		// A full lap without a free slot, sleep until one is released since the lap started
+		header_->clients_waiting.fetch_add(1);
+		if (header_->released.load() == released) ring::FutexWait(header_->released, released, kReplyWaitNs);
+		header_->clients_waiting.fetch_sub(1);
+	}
+	return {};
+}
+
+ring::Status RingClient::Tokenize(const std::string_view text, std::vector <uint32_t> &ids) const {
+	Lease lease = Acquire();
+	if (!lease.IsValid()) return ring::STOPPED;
+	if (text.size() > lease.Buffer().size()) return ring::TOO_LARGE;
+	memcpy(lease.Buffer().data(), text.data(), text.size());
+	const ring::Status status = lease.Submit(ring::TOKENIZE, text.size());
+	if (status == ring::OK) ids.assign(lease.GetIds().begin(), lease.GetIds().end());
+	return status;
+}
+
+ring::Status RingClient::Detokenize(const std::span <const uint32_t> ids, std::string &text) const {
+	Lease lease = Acquire();
+	if (!lease.IsValid()) return ring::STOPPED;
+	if (ids.size_bytes() > lease.Buffer().size()) return ring::TOO_LARGE;
+	memcpy(lease.Buffer().data(), ids.data(), ids.size_bytes());
+	const ring::Status status = lease.Submit(ring::DETOKENIZE, ids.size());
+	if (status == ring::OK) text = lease.GetText();
+	return status;
+}
+
+RingClient::Lease::Lease(const RingClient &client, ring::Slot &slot) :
+	slot_(&slot),
+	buffer_(ring::GetData(slot), client.header_->slot_bytes),
+	client_(&client) {}
+RingClient::Lease::Lease(Lease &&other) noexcept {
+	*this = std::move(other);
+}
+RingClient::Lease &RingClient::Lease::operator=(Lease &&other) noexcept {
+	if (this == &other) return *this;
+	Release();
+	slot_ = std::exchange(other.slot_, nullptr);
+	buffer_ = std::exchange(other.buffer_, {});
+	client_ = std::exchange(other.client_, nullptr);
+	return *this;
+}
+RingClient::Lease::~Lease() {
+	Release();
+}
+
+void RingClient::Lease::Release() {
+	if (slot_ == nullptr) return;
+	ring::Header &header = *client_->header_;
+	// FREE goes first, an owner of 0 always means the slot is FREE
+	slot_->state.store(ring::FREE, std::memory_order_relaxed);
+	slot_->owner.store(0, std::memory_order_release);
+	header.released.fetch_add(1);
+	if (header.clients_waiting.load()) ring::FutexWake(header.released, 1);
+}
+
+ring::Status RingClient::Lease::Submit(const ring::Op op, const size_t size) {
+	ring::Header &header = *client_->header_;
+	slot_->op = op;
+	slot_->size = size;
+	slot_->state.store(ring::REQUEST);
+	header.doorbell.fetch_add(1);
+	if (header.server_waiting.load()) ring::FutexWake(header.doorbell, 1);
+
+	while (true) {
+		const uint32_t state = slot_->state.load(std::memory_order_acquire);
+		if (state == ring::DONE) break;
+		if (header.stopped.load()) {
+			// The server may still be writing into the slot, so it is never reused
+			slot_ = nullptr;
+			return ring::STOPPED;
+		}
+		slot_->client_waiting.store(1);
+		ring::FutexWait(slot_->state, state, kReplyWaitNs);
+		slot_->client_waiting.store(0);
+	}
+	slot_->state.store(ring::CLAIMED, std::memory_order_relaxed);
+	return (ring::Status)slot_->status;
+}
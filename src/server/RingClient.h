@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "SharedRing.h"
+
+/**
+ * Client side of the shared memory ring RingServer creates. Thread safe: every request has a slot of its own.
+ */
+class RingClient {
+	ring::Header *header_ = nullptr;
+	size_t map_size_ = 0;
+
+public:
+	/**
+	 * One claimed slot. Write the request into Buffer, Submit it, then read the response in place.
+	 * The slot is handed back when the lease is destroyed.
+	 */
+	class Lease {
+		ring::Slot *slot_ = nullptr;
+		std::span <char> buffer_;
+		const RingClient *client_ = nullptr;
+
+		void Release();
+
+	public:
+		Lease() = default;
+		Lease(const RingClient &client, ring::Slot &slot);
+		Lease(Lease &&other) noexcept;
+		Lease &operator=(Lease &&other) noexcept;
+		~Lease();
+
+		[[nodiscard]] bool IsValid() const { return slot_ != nullptr; }
+		[[nodiscard]] std::span <char> Buffer() const { return buffer_; }
+
+		/**
+		 * Hands the first size bytes of Buffer (or ids, for DETOKENIZE) to the server and waits for the response
+		 * @return OK once the response is in the buffer. With TOO_LARGE, GetSize tells the size it needed.
+		 */
+		ring::Status Submit(ring::Op op, size_t size);
+
+		[[nodiscard]] size_t GetSize() const { return slot_->size; }
+		[[nodiscard]] std::span <const uint32_t> GetIds() const {
+			return {(const uint32_t *)buffer_.data(), slot_->size};
+		}
+		[[nodiscard]] std::string_view GetText() const { return {buffer_.data(), slot_->size}; }
+	};
+
+	/**
+	 * Maps the ring of a running server
+	 * @note If there is none, the object is left invalid
+	 */
+	explicit RingClient(const std::string &name);
+	RingClient(const RingClient &) = delete;
+	RingClient &operator=(const RingClient &) = delete;
+	~RingClient();
+
+	[[nodiscard]] bool IsValid() const { return header_ != nullptr; }
+	[[nodiscard]] size_t GetSlotBytes() const { return header_->slot_bytes; }
+
+	/**
+	 * Claims the next free slot, waiting while all of them are in use
+	 * @return An invalid lease if the server stopped
+	 */
+	Lease Acquire() const;
+
+	/**
+	 * Copies the text into a slot and the ids out of it, for callers that don't hold their data in a lease
+	 */
+	ring::Status Tokenize(std::string_view text, std::vector <uint32_t> &ids) const;
+	ring::Status Detokenize(std::span <const uint32_t> ids, std::string &text) const;
+};
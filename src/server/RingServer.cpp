@@ -0,0 +1,201 @@
+#include "RingServer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <span>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+#include "../files/VocabHandle.h"
+#include "../utils/Multithread.h"
+
+// How long the dispatcher sleeps before looking at the stop flag again, in case a wakeup was lost to a dead client
+constexpr long kIdleWaitNs = 100'000'000;
+// Batches with fewer request bytes are handled on the dispatcher thread, where handing off would cost more than the work
+constexpr size_t kInlineBytes = 1 << 14;
+constexpr size_t kChunksPerThread = 4;
+// How often the dispatcher looks for slots held by clients that exited
+constexpr auto kReclaimInterval = std::chrono::seconds(1);
+
+RingServer::RingServer(const VocabHandle &vocab, ThreadPool &pool) :
+	vocab_(vocab),
+	pool_(pool) {}
+RingServer::~RingServer() {
+	if (header_ == nullptr) return;
+	munmap(header_, map_size_);
+	shm_unlink(name_.c_str());
+}
+
+bool RingServer::Create(const std::string &name, const size_t slot_cnt, const size_t slot_bytes) {
+	if (slot_cnt == 0 || slot_bytes == 0) {
+		errno = EINVAL;
+		return false;
+	}
+	shm_unlink(name.c_str());
+	const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd == -1) return false;
+	const size_t size = ring::RegionSize(slot_cnt, slot_bytes);
+	void *map = MAP_FAILED;
+	if (ftruncate(fd, (off_t)size) == 0) map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	const int err = errno;
+	close(fd);
+	if (map == MAP_FAILED) {
+		shm_unlink(name.c_str());
+		errno = err;
+		return false;
+	}
+
+	// The fresh region is zero filled, so every slot starts FREE. The magic goes last, clients check it.
+	header_ = new (map) ring::Header {};
+	header_->format = ring::kFormat;
+	header_->slot_cnt = slot_cnt;
+	header_->slot_bytes = slot_bytes;
+	for (size_t i = 0; i < slot_cnt; i++) {
+		new (&GetSlot(i)) ring::Slot {};
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(header_->magic, ring::kMagic, sizeof ring::kMagic);
+	name_ = name;
+	map_size_ = size;
+	slot_cnt_ = slot_cnt;
+	slot_bytes_ = slot_bytes;
+	return true;
+}
+
+ring::Slot &RingServer::GetSlot(const size_t index) const {
+	return *(ring::Slot *)((char *)header_ + sizeof(ring::Header) + index * ring::SlotStride(slot_bytes_));
+}
+
+void RingServer::Stop() {
+	stop_ = true;
+	if (header_ == nullptr) return;
+	header_->doorbell.fetch_add(1);
+	ring::FutexWake(header_->doorbell, 1);
+}
+
+void RingServer::Handle(ring::Slot &slot, const uint64_t size) const {
+	thread_local std::string text;
+	char *data = ring::GetData(slot);
+	const size_t capacity = slot_bytes_;
+	// The client can still write the slot, so op and size are read once and only the copies are checked and used.
+	// Process reads the size, which it also needs to split the batch.
+	const uint32_t op = std::atomic_ref(slot.op).load(std::memory_order_acquire);
+	const VocabHandle::Reader tkn = vocab_.Read();
+	switch (op) {
+	case ring::TOKENIZE: {
+		if (size > capacity) break;
+		// The ids overwrite the text as they are written, so the tokenizer reads a private copy
+		text.assign(data, size);
+		const std::span <uint32_t> ids((uint32_t *)data, capacity / sizeof(uint32_t));
+		const size_t cnt = tkn->Tokenize(text, ids);
+		slot.size = cnt;
+		slot.status = cnt <= ids.size() ? ring::OK : ring::TOO_LARGE;
+		return;
+	}
+	case ring::DETOKENIZE: {
+		if (size > capacity / sizeof(uint32_t)) break;
+		text = tkn->Detokenize(std::span <const uint32_t>((const uint32_t *)data, size));
+		const bool fits = text.size() <= capacity;
+		if (fits) memcpy(data, text.data(), text.size());
+		slot.size = text.size();
+		slot.status = fits ? ring::OK : ring::TOO_LARGE;
+		return;
+	}
+	}
+	slot.status = ring::BAD_REQUEST;
+	slot.size = 0;
+}
+
+void RingServer::Process(const std::vector <ring::Slot *> &batch) {
+	sizes_.resize(batch.size());
+	size_t total_bytes = 0;
+	for (size_t i = 0; i < batch.size(); i++) {
+		sizes_[i] = std::atomic_ref(batch[i]->size).load(std::memory_order_acquire);
+		total_bytes += std::min(sizes_[i], (uint64_t)slot_bytes_);
+	}
+	if (total_bytes < kInlineBytes || pool_.size() <= 1) {
+		for (size_t i = 0; i < batch.size(); i++) {
+			Handle(*batch[i], sizes_[i]);
+		}
+		return;
+	}
+
+	const size_t chunk_bytes = std::max(total_bytes / (kChunksPerThread * pool_.size()), (size_t)1);
+	std::vector <ThreadPool::TaskRef> tasks;
+	for (size_t begin = 0, end = 0, bytes = 0; end < batch.size(); ) {
+		bytes += std::min(sizes_[end++], (uint64_t)slot_bytes_);
+		if (bytes < chunk_bytes && end < batch.size()) continue;
+		tasks.push_back(pool_.Enqueue([this, &batch, begin, end] {
+			for (size_t i = begin; i < end; i++) {
+				Handle(*batch[i], sizes_[i]);
+			}
+		}));
+		begin = end;
+		bytes = 0;
+	}
+	pool_.Wait(std::move(tasks));
+}
+
+void RingServer::ReclaimDead() const {
+	bool reclaimed = false;
+	for (size_t i = 0; i < slot_cnt_; i++) {
+		ring::Slot &slot = GetSlot(i);
+		const uint32_t owner = slot.owner.load(std::memory_order_acquire);
+		if (owner == 0 || kill((pid_t)owner, 0) == 0 || errno != ESRCH) continue;
+		// Only the server clears the owner of a dead client, so if it is still set, the slot can't change under us
+		if (slot.owner.load(std::memory_order_acquire) != owner) continue;
+		// A request the client left is answered first, like any other, and the slot is reclaimed once DONE
+		const uint32_t state = slot.state.load(std::memory_order_acquire);
+		if (state == ring::REQUEST || state == ring::BUSY) continue;
+		slot.state.store(ring::FREE, std::memory_order_relaxed);
+		slot.owner.store(0, std::memory_order_release);
+		reclaimed = true;
+	}
+	if (!reclaimed) return;
+	header_->released.fetch_add(1);
+	if (header_->clients_waiting.load()) ring::FutexWake(header_->released, INT_MAX);
+}
+
+void RingServer::Run() {
+	if (header_ == nullptr) return;
+	std::vector <ring::Slot *> batch;
+	auto last_reclaim = std::chrono::steady_clock::now();
+	while (!stop_) {
+		const auto now = std::chrono::steady_clock::now();
+		if (now - last_reclaim >= kReclaimInterval) {
+			ReclaimDead();
+			last_reclaim = now;
+		}
+		const uint32_t doorbell = header_->doorbell.load();
+		batch.clear();
+		for (size_t i = 0; i < slot_cnt_; i++) {
+			ring::Slot &slot = GetSlot(i);
+			uint32_t state = ring::REQUEST;
+			if (slot.state.compare_exchange_strong(state, ring::BUSY, std::memory_order_acquire)) batch.push_back(&slot);
+		}
+		if (batch.empty()) {
+			header_->server_waiting.store(1);
+			if (header_->doorbell.load() == doorbell && !stop_) ring::FutexWait(header_->doorbell, doorbell, kIdleWaitNs);
+			header_->server_waiting.store(0);
+			continue;
+		}
+
+		Process(batch);
+		for (ring::Slot *slot : batch) {
+			slot->state.store(ring::DONE);
+			if (slot->client_waiting.load()) ring::FutexWake(slot->state, 1);
+		}
+	}
+
+	// Clients check the flag before sleeping, the wakeups cover those already asleep
+	header_->stopped.store(1);
+	for (size_t i = 0; i < slot_cnt_; i++) {
+		ring::FutexWake(GetSlot(i).state, 1);
+	}
+	ring::FutexWake(header_->released, INT_MAX);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "SharedRing.h"
+
+class VocabHandle;
+class ThreadPool;
+
+/**
+ * Serves a vocabulary through a shared memory ring (see SharedRing.h), for clients on the same machine.
+ * Each request pins the vocabulary of the VocabHandle on its own, as in TokenServer.
+ * Requests are read from and answered into the shared slots, so no byte goes through the kernel.
+ * A dispatcher thread collects every submitted slot into a batch, which is processed on the thread pool.
+ */
+class RingServer {
+	const VocabHandle &vocab_;
+	ThreadPool &pool_;
+	std::string name_;
+	ring::Header *header_ = nullptr;
+	size_t map_size_ = 0;
+	// Copies of the layout, since clients can write the header
+	size_t slot_cnt_ = 0;
+	size_t slot_bytes_ = 0;
+	std::atomic <bool> stop_ = false;
+	// The request size of each slot in the batch, read once since clients can write it
+	std::vector <uint64_t> sizes_;
+
+	[[nodiscard]] ring::Slot &GetSlot(size_t index) const;
+	void Handle(ring::Slot &slot, uint64_t size) const;
+	void Process(const std::vector <ring::Slot *> &batch);
+	/**
+	 * Hands back the slots of clients that exited while holding them, so crashed clients can't use up the ring
+	 */
+	void ReclaimDead() const;
+
+public:
+	RingServer(const VocabHandle &vocab, ThreadPool &pool);
+	RingServer(const RingServer &) = delete;
+	RingServer &operator=(const RingServer &) = delete;
+	~RingServer();
+
+	/**
+	 * Creates the shared memory region, replacing a stale one of the same name
+	 * @param name A POSIX shared memory name, e.g. "/tokenizer"
+	 * @param slot_cnt Requests in flight at once, across all clients
+	 * @param slot_bytes Largest request or response. Tokenizing needs 4 bytes per id in the result.
+	 * @return False if the region can't be created, with errno set
+	 */
+	bool Create(const std::string &name, size_t slot_cnt = 64, size_t slot_bytes = 1 << 20);
+	/**
+	 * Serves requests until Stop is called, then fails every request still waiting with STOPPED
+	 */
+	void Run();
+	/**
+	 * Makes Run return after its current batch. Safe to call from a signal handler.
+	 */
+	void Stop();
+};
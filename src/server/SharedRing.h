@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Layout of the shared memory region RingServer creates and RingClient maps.
+ * It is a header followed by a ring of slots. Each slot holds one request and, in the same bytes, its response:
+ * clients write UTF-8 text or ids straight into a slot and the server writes the result back over them.
+ *
+ * A slot goes FREE -> CLAIMED -> REQUEST -> BUSY -> DONE -> FREE. Clients claim slots in ring order and
+ * sleep on the slot state until it is DONE; the server sleeps on the doorbell until a request is submitted.
+ * When every slot is taken, clients sleep on the release count until one is handed back.
+ * Futex wake calls are only made when some side announced it is about to sleep.
+ *
+ * A slot is claimed by setting its owner from 0 to the client's pid. The server hands back the slots of clients that
+ * exited without releasing them, once it answered any request they left, so clients have to share its pid namespace.
+ */
+namespace ring {
+	constexpr char kMagic[8] = {'T', 'K', 'N', 'R', 'I', 'N', 'G', '\0'};
+	// Bump whenever the layout below changes
+	constexpr uint32_t kFormat = 3;
+	constexpr size_t kAlign = 64;
+
+	enum Op : uint32_t {
+		TOKENIZE = 1,   // UTF-8 text in, uint32 ids from <START> to <END> out
+		DETOKENIZE = 2  // uint32 ids in, text out
+	};
+	enum Status : uint32_t {
+		OK = 0,
+		BAD_REQUEST = 1,
+		TOO_LARGE = 2,  // the response doesn't fit the slot, size holds what it would need
+		STOPPED = 3     // the server shut down
+	};
+	enum State : uint32_t {
+		FREE,
+		CLAIMED,
+		REQUEST,
+		BUSY,
+		DONE
+	};
+
+	struct alignas(kAlign) Header {
+		char magic[8];
+		uint32_t format;
+		uint32_t slot_cnt;
+		uint64_t slot_bytes;                // data bytes of each slot
+		std::atomic <uint32_t> stopped;
+		std::atomic <uint32_t> next_slot;   // ticket of the next slot clients try to claim
+		alignas(kAlign) std::atomic <uint32_t> doorbell; // bumped on every submit
+		std::atomic <uint32_t> server_waiting;
+		alignas(kAlign) std::atomic <uint32_t> released; // bumped whenever a slot goes back to FREE
+		std::atomic <uint32_t> clients_waiting;          // clients sleeping on released
+	};
+	struct alignas(kAlign) Slot {
+		std::atomic <uint32_t> state;
+		std::atomic <uint32_t> client_waiting;
+		std::atomic <uint32_t> owner;       // pid of the client holding the slot, 0 while it is FREE
+		uint32_t op;
+		uint32_t status;
+		uint64_t size;                      // bytes or ids of the request, then of the response
+	};
+
+	constexpr size_t AlignUp(const size_t size) {
+		return (size + kAlign - 1) & ~(kAlign - 1);
+	}
+	constexpr size_t SlotStride(const size_t slot_bytes) {
+		return sizeof(Slot) + AlignUp(slot_bytes);
+	}
+	constexpr size_t RegionSize(const size_t slot_cnt, const size_t slot_bytes) {
+		return sizeof(Header) + slot_cnt * SlotStride(slot_bytes);
+	}
+	inline Slot &GetSlot(Header &header, const size_t index) {
+		return *(Slot *)((char *)&header + sizeof(Header) + index * SlotStride(header.slot_bytes));
+	}
+	inline char *GetData(Slot &slot) {
+		return (char *)&slot + sizeof(Slot);
+	}
+
+	// Process-shared futex calls: the words live in memory mapped by several processes
+	inline void FutexWait(std::atomic <uint32_t> &word, const uint32_t expected, const long timeout_ns) {
+		const timespec timeout {0, timeout_ns};
+		syscall(SYS_futex, &word, FUTEX_WAIT, expected, &timeout, nullptr, 0);
+	}
+	inline void FutexWake(std::atomic <uint32_t> &word, const int count) {
+		syscall(SYS_futex, &word, FUTEX_WAKE, count, nullptr, nullptr, 0);
+	}
+
+	static_assert(std::atomic <uint32_t>::is_always_lock_free, "Futex words must be plain integers");
+}
@@ -0,0 +1,299 @@
+#include "TokenServer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <span>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../files/VocabHandle.h"
+#include "../utils/Multithread.h"
+
+static_assert(std::endian::native == std::endian::little, "The wire format is little endian");
+
+constexpr size_t kHeaderBytes = sizeof(uint32_t);
+// Bytes read per call, and at most per connection and poll so one fast client can't starve the others
+constexpr size_t kReadChunk = 1 << 16;
+constexpr size_t kReadBudget = 1 << 22;
+// Batches with fewer payload bytes are handled on the I/O thread, where handing off would cost more than the work
+constexpr size_t kInlineBytes = 1 << 14;
+constexpr size_t kChunksPerThread = 4;
+constexpr const char *kOpNames[] = {"", "tokenize", "detokenize", "stats"};
+
+struct TokenServer::Connection {
+	int fd;
+	std::string in;
+	size_t parsed = 0;
+	std::string out;
+	size_t sent = 0;
+	bool eof = false;
+	bool broken = false;
+
+	explicit Connection(const int fd) : fd(fd) {}
+	~Connection() { close(fd); }
+
+	[[nodiscard]] bool HasFrame() const {
+		uint32_t size = 0;
+		if (in.size() - parsed >= kHeaderBytes) memcpy(&size, in.data() + parsed, kHeaderBytes);
+		return size != 0 && in.size() - parsed - kHeaderBytes >= size;
+	}
+	[[nodiscard]] bool IsBackedUp() const { return out.size() - sent > kMaxPending; }
+	// Done once the peer hung up and everything it asked for was answered. A partial last frame is never completed.
+	[[nodiscard]] bool IsFinished() const { return broken || (eof && !HasFrame() && sent == out.size()); }
+};
+
+TokenServer::TokenServer(const VocabHandle &vocab, ThreadPool &pool) :
+	vocab_(vocab),
+	pool_(pool) {
+	if (pipe2(wake_fds_, O_NONBLOCK | O_CLOEXEC) == -1) wake_fds_[0] = wake_fds_[1] = -1;
+}
+TokenServer::~TokenServer() {
+	conns_.clear();
+	if (listen_fd_ != -1) {
+		close(listen_fd_);
+		unlink(path_.c_str());
+	}
+	for (const int fd : wake_fds_) {
+		if (fd != -1) close(fd);
+	}
+}
+
+bool TokenServer::Listen(const std::string &path) {
+	sockaddr_un addr {};
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof addr.sun_path) {
+		errno = ENAMETOOLONG;
+		return false;
+	}
+	memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1) return false;
+	// Only a socket is replaced, never a file that happens to be at the path
+	struct stat info {};
+	if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) unlink(path.c_str());
+	if (bind(fd, (const sockaddr *)&addr, sizeof addr) == -1 || listen(fd, SOMAXCONN) == -1) {
+		const int err = errno;
+		close(fd);
+		errno = err;
+		return false;
+	}
+	listen_fd_ = fd;
+	path_ = path;
+	return true;
+}
+
+void TokenServer::Stop() {
+	const char byte = 0;
+	[[maybe_unused]] const ssize_t ignored = write(wake_fds_[1], &byte, 1);
+}
+
+void TokenServer::Accept() {
+	while (true) {
+		const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd == -1) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		conns_.push_back(std::make_unique <Connection>(fd));
+	}
+}
+
+bool TokenServer::Receive(Connection &conn) {
+	for (size_t total = 0; total < kReadBudget;) {
+		const size_t size = conn.in.size();
+		conn.in.resize(size + kReadChunk);
+		const ssize_t got = read(conn.fd, conn.in.data() + size, kReadChunk);
+		conn.in.resize(size + std::max(got, (ssize_t)0));
+		if (got > 0) {
+			total += got;
+			continue;
+		}
+		if (got == 0) {
+			conn.eof = true;
+			return true;
+		}
+		if (errno == EINTR) continue;
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	}
+	return true;
+}
+
+bool TokenServer::Send(Connection &conn) {
+	while (conn.sent < conn.out.size()) {
+		const ssize_t put = send(conn.fd, conn.out.data() + conn.sent, conn.out.size() - conn.sent, MSG_NOSIGNAL);
+		if (put >= 0) {
+			conn.sent += put;
+			continue;
+		}
+		if (errno == EINTR) continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+		// Drop what was sent once it is most of the buffer, so a reader that never quite catches up doesn't grow it
+		if (conn.sent > conn.out.size() / 2) {
+			conn.out.erase(0, conn.sent);
+			conn.sent = 0;
+		}
+		return true;
+	}
+	conn.out.clear();
+	conn.sent = 0;
+	return true;
+}
+
+bool TokenServer::ParseFrames(Connection &conn, std::vector <Request> &batch) {
+	const Clock::time_point now = Clock::now();
+	while (batch.size() < kMaxBatch && conn.in.size() - conn.parsed >= kHeaderBytes) {
+		uint32_t size;
+		memcpy(&size, conn.in.data() + conn.parsed, kHeaderBytes);
+		if (size == 0 || size > kMaxFrame) return false;
+		if (conn.in.size() - conn.parsed - kHeaderBytes < size) break;
+		const char *frame = conn.in.data() + conn.parsed + kHeaderBytes;
+		batch.push_back({&conn, (Op)frame[0], {frame + 1, size - (size_t)1}, now, OK, {}});
+		conn.parsed += kHeaderBytes + size;
+	}
+	return true;
+}
+
+void TokenServer::Handle(Request &request) const {
+	thread_local std::vector <uint32_t> ids;
+	// Pinned per request, so a reload never waits on more than one request per thread
+	const VocabHandle::Reader tkn = vocab_.Read();
+	switch (request.op) {
+	case TOKENIZE:
+		tkn->Tokenize(request.payload, ids);
+		request.response.assign((const char *)ids.data(), ids.size() * sizeof(uint32_t));
+		return;
+	case DETOKENIZE:
+		if (request.payload.size() % sizeof(uint32_t) != 0) {
+			request.status = BAD_REQUEST;
+			request.response = "ids must be 4 bytes each";
+			return;
+		}
+		ids.resize(request.payload.size() / sizeof(uint32_t));
+		memcpy(ids.data(), request.payload.data(), request.payload.size());
+		request.response = tkn->Detokenize(std::span <const uint32_t>(ids));
+		return;
+	case STATS:
+		request.response = FormatStats();
+		return;
+	}
+	request.status = BAD_REQUEST;
+	request.response = "unknown op";
+}
+
+void TokenServer::Process(std::vector <Request> &batch) {
+	size_t total_bytes = 0;
+	for (const Request &request : batch) {
+		total_bytes += request.payload.size();
+	}
+	if (total_bytes < kInlineBytes || pool_.size() <= 1) {
+		for (Request &request : batch) {
+			Handle(request);
+		}
+		return;
+	}
+
+	const size_t chunk_bytes = std::max(total_bytes / (kChunksPerThread * pool_.size()), (size_t)1);
+	std::vector <ThreadPool::TaskRef> tasks;
+	for (size_t begin = 0, end = 0, bytes = 0; end < batch.size(); ) {
+		bytes += batch[end++].payload.size();
+		if (bytes < chunk_bytes && end < batch.size()) continue;
+		tasks.push_back(pool_.Enqueue([this, &batch, begin, end] {
+			for (size_t i = begin; i < end; i++) {
+				Handle(batch[i]);
+			}
+		}));
+		begin = end;
+		bytes = 0;
+	}
+	pool_.Wait(std::move(tasks));
+}
+
+void TokenServer::Respond(Request &request) {
+	std::string &out = request.conn->out;
+	const auto size = (uint32_t)(request.response.size() + 1);
+	out.append((const char *)&size, kHeaderBytes);
+	out += (char)request.status;
+	out += request.response;
+	std::string().swap(request.response);
+
+	const auto nanos = std::chrono::duration_cast <std::chrono::nanoseconds>(Clock::now() - request.received);
+	if (request.status == OK) latency_[request.op].Record(nanos.count());
+	else rejected_++;
+}
+
+void TokenServer::Run() {
+	std::vector <pollfd> fds;
+	std::vector <Request> batch;
+	size_t first_conn = 0;
+	bool backlog = false;
+	while (true) {
+		fds.clear();
+		fds.push_back({wake_fds_[0], POLLIN, 0});
+		fds.push_back({listen_fd_, POLLIN, 0});
+		for (const auto &conn : conns_) {
+			// A client that doesn't read its replies isn't read from either, until they drain
+			short events = conn->eof || conn->IsBackedUp() ? 0 : POLLIN;
+			if (conn->sent < conn->out.size()) events |= POLLOUT;
+			fds.push_back({conn->fd, events, 0});
+		}
+		if (poll(fds.data(), fds.size(), backlog ? 0 : -1) == -1 && errno != EINTR) break;
+		if (fds[0].revents & POLLIN) break;
+
+		for (size_t i = 0; i + 2 < fds.size(); i++) {
+			Connection &conn = *conns_[i];
+			if (fds[i + 2].revents & POLLERR) conn.broken = true;
+			else if (!conn.IsBackedUp() && fds[i + 2].revents & (POLLIN | POLLHUP)) conn.broken |= !Receive(conn);
+			if (fds[i + 2].revents & POLLOUT) conn.broken |= !Send(conn);
+		}
+		if (fds[1].revents & POLLIN) Accept();
+
+		// Start from a different connection each time so a busy one can't keep the others out of full batches
+		batch.clear();
+		for (size_t i = 0; i < conns_.size() && batch.size() < kMaxBatch; i++) {
+			Connection &conn = *conns_[(first_conn + i) % conns_.size()];
+			if (!conn.broken && !conn.IsBackedUp() && !ParseFrames(conn, batch)) {
+				conn.broken = true;
+				rejected_++;
+			}
+		}
+		first_conn = conns_.empty() ? 0 : (first_conn + 1) % conns_.size();
+		backlog = batch.size() == kMaxBatch;
+
+		Process(batch);
+		for (Request &request : batch) {
+			Respond(request);
+		}
+		for (const auto &conn : conns_) {
+			conn->in.erase(0, conn->parsed);
+			conn->parsed = 0;
+			if (!conn->broken && conn->sent < conn->out.size()) conn->broken = !Send(*conn);
+		}
+		std::erase_if(conns_, [](const std::unique_ptr <Connection> &conn) { return conn->IsFinished(); });
+	}
+}
+
+std::string TokenServer::FormatStats() const {
+	std::string report;
+	char line[256];
+	for (const Op op : {TOKENIZE, DETOKENIZE, STATS}) {
+		const LatencyHistogram &latency = latency_[op];
+		snprintf(line, sizeof line,
+		         "%s: %lu requests, mean %.1f us, p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+		         kOpNames[op], latency.GetCount(), latency.GetMean() / 1e3, latency.GetPercentile(0.5) / 1e3,
+		         latency.GetPercentile(0.9) / 1e3, latency.GetPercentile(0.99) / 1e3,
+		         latency.GetPercentile(0.999) / 1e3, latency.GetMax() / 1e3);
+		report += line;
+	}
+	snprintf(line, sizeof line, "rejected: %lu requests\n", rejected_.load());
+	report += line;
+	return report;
+}
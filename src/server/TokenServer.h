@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "LatencyHistogram.h"
+
+class VocabHandle;
+class ThreadPool;
+
+/**
+ * Serves a vocabulary over a UNIX domain socket, so many processes share a single warm tokenizer.
+ * Each request pins the vocabulary of the VocabHandle on its own, so a reload takes effect from the next request.
+ *
+ * Every message is a frame: a little endian uint32 byte count, then that many bytes.
+ * A request frame starts with an Op byte, a response frame with a Status byte, each followed by its payload:
+ *  - TOKENIZE: UTF-8 text, answered with uint32 ids from <START> to <END>
+ *  - DETOKENIZE: uint32 ids, answered with the text
+ *  - STATS: empty, answered with a text report of request latencies
+ * A client may pipeline requests; the responses on a connection come back in the same order.
+ *
+ * A single thread does all the socket I/O. The requests complete on all connections after each poll are
+ * processed as one batch on the thread pool, and the responses are written back without blocking.
+ */
+class TokenServer {
+public:
+	enum Op : uint8_t {
+		TOKENIZE = 1,
+		DETOKENIZE = 2,
+		STATS = 3
+	};
+	enum Status : uint8_t {
+		OK = 0,
+		BAD_REQUEST = 1
+	};
+
+	// Larger frames close the connection
+	static constexpr size_t kMaxFrame = 64 << 20;
+	// Requests handled per batch, the rest wait for the next one
+	static constexpr size_t kMaxBatch = 1024;
+	// Reply bytes a client hasn't read yet, past which its requests aren't read until it catches up
+	static constexpr size_t kMaxPending = 64 << 20;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Connection;
+	struct Request {
+		Connection *conn;
+		Op op;
+		std::string_view payload;
+		Clock::time_point received;
+		Status status = OK;
+		std::string response;
+	};
+
+	const VocabHandle &vocab_;
+	ThreadPool &pool_;
+	int listen_fd_ = -1;
+	int wake_fds_[2] = {-1, -1};
+	std::string path_;
+	std::vector <std::unique_ptr <Connection>> conns_;
+	std::array <LatencyHistogram, STATS + 1> latency_;
+	std::atomic <uint64_t> rejected_ = 0;
+
+	void Accept();
+	// Reads what is available, returns false once the connection is to be dropped
+	static bool Receive(Connection &conn);
+	static bool Send(Connection &conn);
+	// Moves complete frames into the batch, returns false on a malformed frame
+	static bool ParseFrames(Connection &conn, std::vector <Request> &batch);
+	void Handle(Request &request) const;
+	void Process(std::vector <Request> &batch);
+	void Respond(Request &request);
+
+public:
+	TokenServer(const VocabHandle &vocab, ThreadPool &pool);
+	TokenServer(const TokenServer &) = delete;
+	TokenServer &operator=(const TokenServer &) = delete;
+	~TokenServer();
+
+	/**
+	 * Binds the socket, replacing a stale socket file left at the path
+	 * @return False if the socket can't be created, with errno set
+	 */
+	bool Listen(const std::string &path);
+	/**
+	 * Serves requests until Stop is called
+	 */
+	void Run();
+	/**
+	 * Makes Run return after its current batch. Safe to call from a signal handler.
+	 */
+	void Stop();
+
+	[[nodiscard]] const LatencyHistogram &GetLatency(const Op op) const { return latency_[op]; }
+	/**
+	 * @return Request counts and latency percentiles of every op, one line each
+	 */
+	[[nodiscard]] std::string FormatStats() const;
+};
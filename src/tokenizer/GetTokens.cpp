@@ -1,6 +1,7 @@
 #include "GetTokens.h"
 
 #include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
@@ -9,8 +10,13 @@
 
 #include <utf8cpp/utf8.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 #include "../files/DataFile.h"
 #include "../files/MetadataFile.h"
+#include "../utils/CpuFeatures.h"
 #include "../utils/Multithread.h"
 #include "Trie.h"
 
@@ -18,9 +24,128 @@ using namespace annealing;
 
 // TODO add check for candidate max len and rebuild if false
 
+// Each kernel decodes from in into out while a whole register of text is left, widening runs of ASCII a register at
+// a time and everything else one code point at a time with utf8cpp
+using DecodeKernel = void (*)(const char *&in, const char *end, char32_t *&out);
+
+// Widens the ASCII bytes before the first multi-byte sequence in the register, then decodes that sequence
+void DecodeSequence(const char *&in, char32_t *&out, const int ascii) {
+	for (int i = 0; i < ascii; i++) {
+		*out++ = (unsigned char)*in++;
+	}
+	*out++ = utf8::unchecked::next(in);
+}
+
+void DecodeScalar(const char *&in, const char *end, char32_t *&out) {
+	constexpr uint64_t kHighBits = 0x8080808080808080;
+	while (end - in >= 8) {
+		uint64_t text;
+		memcpy(&text, in, 8);
+		if (text & kHighBits) {
+			*out++ = utf8::unchecked::next(in);
+			continue;
+		}
+		for (int i = 0; i < 8; i++) {
+			out[i] = (unsigned char)in[i];
+		}
+		in += 8;
+		out += 8;
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+void DecodeSse2(const char *&in, const char *end, char32_t *&out) {
+	const __m128i zero = _mm_setzero_si128();
+	while (end - in >= 16) {
+		const __m128i text = _mm_loadu_si128((const __m128i *)in);
+		const uint32_t wide = _mm_movemask_epi8(text);
+		if (wide != 0) {
+			DecodeSequence(in, out, __builtin_ctz(wide));
+			continue;
+		}
+		const __m128i low = _mm_unpacklo_epi8(text, zero);
+		const __m128i high = _mm_unpackhi_epi8(text, zero);
+		_mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi16(low, zero));
+		_mm_storeu_si128((__m128i *)(out + 4), _mm_unpackhi_epi16(low, zero));
+		_mm_storeu_si128((__m128i *)(out + 8), _mm_unpacklo_epi16(high, zero));
+		_mm_storeu_si128((__m128i *)(out + 12), _mm_unpackhi_epi16(high, zero));
+		in += 16;
+		out += 16;
+	}
+}
+
+__attribute__((target("avx2")))
+void DecodeAvx2(const char *&in, const char *end, char32_t *&out) {
+	while (end - in >= 32) {
+		const uint32_t wide = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)in));
+		if (wide != 0) {
+			DecodeSequence(in, out, __builtin_ctz(wide));
+			continue;
+		}
+		for (int i = 0; i < 32; i += 8) {
+			const __m128i text = _mm_loadl_epi64((const __m128i *)(in + i));
+			_mm256_storeu_si256((__m256i *)(out + i), _mm256_cvtepu8_epi32(text));
+		}
+		in += 32;
+		out += 32;
+	}
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void DecodeAvx512(const char *&in, const char *end, char32_t *&out) {
+	while (end - in >= 64) {
+		const uint64_t wide = _mm512_movepi8_mask(_mm512_loadu_si512(in));
+		if (wide != 0) {
+			DecodeSequence(in, out, __builtin_ctzll(wide));
+			continue;
+		}
+		for (int i = 0; i < 64; i += 16) {
+			const __m128i text = _mm_loadu_si128((const __m128i *)(in + i));
+			// Same as _mm512_cvtepu8_epi32, whose undefined passthrough register GCC warns about
+			_mm512_storeu_si512(out + i, _mm512_maskz_cvtepu8_epi32(0xFFFF, text));
+		}
+		in += 64;
+		out += 64;
+	}
+}
+#endif
+
+DecodeKernel SelectDecodeKernel(const SimdLevel level) {
+#if defined(__x86_64__) || defined(__i386__)
+	switch (std::min(level, GetSimdLevel())) {
+	case AVX512: return DecodeAvx512;
+	case AVX2: return DecodeAvx2;
+	case SSE2: return DecodeSse2;
+	case SCALAR: break;
+	}
+#endif
+	return DecodeScalar;
+}
+
+void DecodeWith(const DecodeKernel kernel, const std::string_view text, std::vector <char32_t> &parsed) {
+	// A code point takes at least a byte
+	parsed.resize(text.size());
+	const char *in = text.data();
+	const char *end = text.data() + text.size();
+	char32_t *out = parsed.data();
+	kernel(in, end, out);
+	while (in < end) {
+		*out++ = utf8::unchecked::next(in);
+	}
+	parsed.resize(out - parsed.data());
+}
+
+std::vector <char32_t> annealing::DecodeUtf8(const std::string_view text, const SimdLevel level) {
+	std::vector <char32_t> parsed;
+	DecodeWith(SelectDecodeKernel(level), text, parsed);
+	return parsed;
+}
+
 void ExtractCandidates(Trie &into, const std::string &text, const uint8_t max_token_length) {
+	static const DecodeKernel kernel = SelectDecodeKernel(GetSimdLevel());
 	std::vector <char32_t> parsed;
-	utf8::unchecked::utf8to32(text.data(), text.data() + text.size(), back_inserter(parsed));
+	DecodeWith(kernel, text, parsed);
 	for (size_t i = 0; i < parsed.size(); i++) {
 		into.AddString(parsed.data() + i, std::min(parsed.size() - i, (size_t)max_token_length));
 	}
@@ -44,19 +169,21 @@ Trie FileCandidates(const MetadataFile &metadata, const uint8_t max_len, const s
 
 	for (int i = 0; i < files.size(); i++) {
 		auto path = root_path / files[i].path;
-		const DataFile file(path);
-		if (!file.IsValid()) {
+		// A file with an error anywhere is skipped whole, as when files were parsed in one go, so the candidates
+		// don't depend on where the error is
+		if (!DataFile(path).Validate()) {
 			std::cerr << "Invalid file " << path << std::endl;
 			continue;
 		}
+		DataFile file(path);
 		if (i >= 3) {
 			pool.Wait({dep_queue.front()});
 			dep_queue.pop();
 		}
 		std::cout << "File " << i << " started" << std::endl;
 		std::vector <ThreadPool::TaskRef> tasks;
-		for (const auto &entry : file.GetEntries()) {
-			tasks.push_back(pool.Enqueue([text = entry.text, max_len, &global_freq, &merge_mutex, &local_freq, &map_mutex] {
+		for (const DataFile::Entry &entry : file) {
+			tasks.push_back(pool.Enqueue([text = std::string(entry.text), max_len, &global_freq, &merge_mutex, &local_freq, &map_mutex] {
 				std::unique_lock lock(map_mutex);
 				Trie *my_freq = &local_freq[std::this_thread::get_id()];
 				lock.unlock();
@@ -68,7 +195,7 @@ Trie FileCandidates(const MetadataFile &metadata, const uint8_t max_len, const s
 				lock.unlock();
 				std::lock_guard merge_lock(merge_mutex);
 				global_freq.Merge(node.mapped());
-				std::cout << (double)((global_freq.size() + 20 * kMergeSize) * (40 + 24)) / (1 << 20) << '\n';
+				std::cout << (double)((global_freq.size() + 20 * kMergeSize) * Trie::kNodeBytes) / (1 << 20) << '\n';
 			}));
 		}
 		dep_queue.push(pool.Enqueue([i] {
@@ -1,8 +1,18 @@
 #pragma once
 
+#include <string_view>
+#include <vector>
+
 #include "Token.h"
 #include "../files/MetadataFile.h"
+#include "../utils/CpuFeatures.h"
 
 namespace annealing {
+	/**
+	 * Decodes valid UTF-8 into code points, as candidate extraction does, with the kernel of a given level rather than
+	 * the best one. To check kernels against each other. Levels above GetSimdLevel use its kernel.
+	 */
+	std::vector <char32_t> DecodeUtf8(std::string_view text, SimdLevel level);
+
 	std::vector <Token> GetTokens (const MetadataFile &metadata, uint8_t max_len = UINT8_MAX, size_t file_cnt = -1, bool rebuild = false);
 }
\ No newline at end of file
@@ -1,37 +1,188 @@
 #include "Trie.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 using namespace annealing;
 
 constexpr size_t kMinFreq = 1;
 
+Trie::Children::Children(Children &&other) noexcept :
+	data_(std::exchange(other.data_, nullptr)),
+	size_(std::exchange(other.size_, 0)),
+	capacity_(std::exchange(other.capacity_, 0)) {}
+Trie::Children &Trie::Children::operator=(Children &&other) noexcept {
+	std::swap(data_, other.data_);
+	std::swap(size_, other.size_);
+	std::swap(capacity_, other.capacity_);
+	return *this;
+}
+Trie::Children::~Children() {
+	::operator delete(data_);
+}
+
+void Trie::Children::Reallocate(const uint32_t capacity) {
+	auto *data = (char32_t *)::operator new(NodesOffset(capacity) * sizeof(char32_t) + capacity * sizeof(Node *));
+	if (size_ != 0) {
+		memcpy(data, data_, size_ * sizeof(char32_t));
+		memcpy(data + NodesOffset(capacity), Nodes(), size_ * sizeof(Node *));
+	}
+	::operator delete(data_);
+	data_ = data;
+	capacity_ = capacity;
+}
+
+void Trie::Children::Insert(const size_t pos, Node *node) {
+	if (size_ == capacity_) Reallocate(std::max <uint32_t>(capacity_ * 2, 1));
+	Node **nodes = Nodes();
+	memmove(data_ + pos + 1, data_ + pos, (size_ - pos) * sizeof(char32_t));
+	memmove(nodes + pos + 1, nodes + pos, (size_ - pos) * sizeof(Node *));
+	data_[pos] = node->chr;
+	nodes[pos] = node;
+	size_++;
+}
+
+void Trie::Children::Insert(const std::vector <Node *> &nodes) {
+	if (size_ + nodes.size() > capacity_) Reallocate(size_ + nodes.size());
+	// Merge from the back, so nothing is overwritten before it is moved
+	Node **to = Nodes();
+	size_t from1 = size_;
+	size_t from2 = nodes.size();
+	for (size_t pos = size_ + nodes.size(); from2 > 0; ) {
+		--pos;
+		if (from1 > 0 && data_[from1 - 1] > nodes[from2 - 1]->chr) {
+			--from1;
+			data_[pos] = data_[from1];
+			to[pos] = to[from1];
+		}
+		else {
+			--from2;
+			data_[pos] = nodes[from2]->chr;
+			to[pos] = nodes[from2];
+		}
+	}
+	size_ += nodes.size();
+}
+
+void Trie::Children::clear() {
+	::operator delete(data_);
+	data_ = nullptr;
+	size_ = 0;
+	capacity_ = 0;
+}
+
 Trie::Node::~Node() {
 	for (const Node *child : children) {
 		delete child;
 	}
 }
 
-size_t Trie::Node::FindChild(const char32_t chd_chr) const {
-	size_t pos = 0;
-	if (children.empty()) return pos;
-	for (size_t pow = 1LL << (63 - __builtin_clzll(children.size() | 1)); pow; pow >>= 1) {
-		const size_t new_pos = pos | pow;
-		if (new_pos < children.size() && children[new_pos]->chr < chd_chr) {
-			pos = new_pos;
+// Each kernel returns the number of chars less than chr, which are sorted.
+// Callers of the vector kernels halve the range down to a few registers of chars, then compare all of those at once.
+using FindKernel = size_t (*)(const char32_t *chars, size_t size, char32_t chr);
+
+// Halves the range until at most window chars are left, returns where it starts
+size_t Narrow(const char32_t *chars, size_t &size, const char32_t chr, const size_t window) {
+	size_t begin = 0;
+	while (size > window) {
+		const size_t half = size / 2;
+		if (chars[begin + half] < chr) {
+			begin += half + 1;
+			size -= half + 1;
+		}
+		else {
+			size = half;
 		}
 	}
-	if (children[pos]->chr < chd_chr) pos++;
-	return pos;
+	return begin;
 }
-bool Trie::Node::CreateChild(const char32_t chd_chr, const size_t pos) {
-	if (pos < children.size() && children[pos]->chr == chd_chr) return false;
-	children.push_back(nullptr);
-	for (size_t i = children.size() - 1; i > pos; --i) {
-		children[i] = children[i - 1];
+
+size_t FindScalar(const char32_t *chars, size_t size, const char32_t chr) {
+	return Narrow(chars, size, chr, 0);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Code points are below 2^21, so the signed compares are exact
+__attribute__((target("sse2")))
+size_t FindSse2(const char32_t *chars, size_t size, const char32_t chr) {
+	const size_t begin = Narrow(chars, size, chr, 16);
+	const __m128i key = _mm_set1_epi32((int)chr);
+	// Lanes that compare true are -1, so subtracting them counts, without needing popcnt
+	__m128i counts = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= size; i += 4) {
+		counts = _mm_sub_epi32(counts, _mm_cmplt_epi32(_mm_loadu_si128((const __m128i *)(chars + begin + i)), key));
+	}
+	counts = _mm_add_epi32(counts, _mm_shuffle_epi32(counts, _MM_SHUFFLE(1, 0, 3, 2)));
+	counts = _mm_add_epi32(counts, _mm_shuffle_epi32(counts, _MM_SHUFFLE(2, 3, 0, 1)));
+	size_t less = _mm_cvtsi128_si32(counts);
+	for (; i < size; i++) {
+		less += chars[begin + i] < chr;
+	}
+	return begin + less;
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t FindAvx2(const char32_t *chars, size_t size, const char32_t chr) {
+	const size_t begin = Narrow(chars, size, chr, 32);
+	const __m256i key = _mm256_set1_epi32((int)chr);
+	size_t less = 0;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		const __m256i lt = _mm256_cmpgt_epi32(key, _mm256_loadu_si256((const __m256i *)(chars + begin + i)));
+		less += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(lt)));
+	}
+	for (; i < size; i++) {
+		less += chars[begin + i] < chr;
+	}
+	return begin + less;
+}
+
+// The tail is a masked load, which never touches the chars past the end
+__attribute__((target("avx512f,popcnt")))
+size_t FindAvx512(const char32_t *chars, size_t size, const char32_t chr) {
+	const size_t begin = Narrow(chars, size, chr, 64);
+	const __m512i key = _mm512_set1_epi32((int)chr);
+	size_t less = 0;
+	for (size_t i = 0; i < size; i += 16) {
+		const __mmask16 lanes = size - i >= 16 ? 0xFFFF : (1 << (size - i)) - 1;
+		const __m512i text = _mm512_maskz_loadu_epi32(lanes, chars + begin + i);
+		less += __builtin_popcount(_mm512_mask_cmplt_epi32_mask(lanes, text, key));
+	}
+	return begin + less;
+}
+#endif
+
+FindKernel SelectFindKernel(const SimdLevel level) {
+#if defined(__x86_64__) || defined(__i386__)
+	switch (std::min(level, GetSimdLevel())) {
+	case AVX512: return FindAvx512;
+	case AVX2: return FindAvx2;
+	case SSE2: return FindSse2;
+	case SCALAR: break;
 	}
-	children[pos] = new Node(chd_chr);
+#endif
+	return FindScalar;
+}
+
+size_t Trie::CountLess(const char32_t *chars, const size_t size, const char32_t chr, const SimdLevel level) {
+	return SelectFindKernel(level)(chars, size, chr);
+}
+
+size_t Trie::Node::FindChild(const char32_t chd_chr) const {
+	static const FindKernel kernel = SelectFindKernel(GetSimdLevel());
+	return kernel(children.chars(), children.size(), chd_chr);
+}
+bool Trie::Node::CreateChild(const char32_t chd_chr, const size_t pos) {
+	if (pos < children.size() && children.chars()[pos] == chd_chr) return false;
+	children.Insert(pos, new Node(chd_chr));
 	sub_size++;
 	return true;
 }
@@ -52,13 +203,13 @@ void Trie::Node::Merge(Node &other, ThreadPoolDummy &pool) {
 		return;
 	}
 	std::vector <Node *> paste;
-	auto pos1 = children.begin();
-	for (auto *pos2 : other.children) {
-		while (pos1 < children.end() && (*pos1)->chr < pos2->chr) {
+	size_t pos1 = 0;
+	for (Node *pos2 : other.children) {
+		while (pos1 < children.size() && children.chars()[pos1] < pos2->chr) {
 			++pos1;
 		}
-		if (pos1 < children.end() && (*pos1)->chr == pos2->chr) {
-			pool.Enqueue([node = *pos1, pos2 = pos2, &pool] {
+		if (pos1 < children.size() && children.chars()[pos1] == pos2->chr) {
+			pool.Enqueue([node = children[pos1], pos2 = pos2, &pool] {
 				node->Merge(*pos2, pool);
 				delete pos2;
 			});
@@ -68,13 +219,7 @@ void Trie::Node::Merge(Node &other, ThreadPoolDummy &pool) {
 		}
 	}
 	other.children.clear();
-
-	size_t from1 = children.size() - 1;
-	children.resize(children.size() + paste.size());
-	auto from2 = paste.rbegin();
-	for (size_t to = children.size() - 1; to < children.size() && to != from1; --to) {
-		children[to] = from1 != -1 && (*from2)->chr < children[from1]->chr ? children[from1--] : *(from2++);
-	}
+	children.Insert(paste);
 	CompSize();
 }
 
@@ -5,6 +5,7 @@
 
 #include "Token.h"
 
+#include "../utils/CpuFeatures.h"
 #include "../utils/Multithread.h"
 
 namespace annealing {
@@ -17,13 +18,52 @@ class annealing::Trie {
 		size_t index;
 	};
 
+	struct Node;
+
+	/**
+	 * The children of a node sorted by chr. Their chars come first and the pointers after them, in a single allocation,
+	 * so FindChild searches one contiguous array and a node costs no more than with a vector of pointers.
+	 * Leaves allocate nothing. The nodes themselves are owned, and deleted, by the parent.
+	 */
+	class Children {
+		char32_t *data_ = nullptr;
+		uint32_t size_ = 0;
+		uint32_t capacity_ = 0;
+
+		// Pointers start after the chars, rounded up to their alignment
+		[[nodiscard]] static size_t NodesOffset(const size_t capacity) { return (capacity + 1) & ~(size_t)1; }
+		[[nodiscard]] Node **Nodes() const { return (Node **)(data_ + NodesOffset(capacity_)); }
+		void Reallocate(uint32_t capacity);
+
+	public:
+		Children() = default;
+		Children(Children &&other) noexcept;
+		Children &operator=(Children &&other) noexcept;
+		~Children();
+
+		[[nodiscard]] size_t size() const { return size_; }
+		[[nodiscard]] bool empty() const { return size_ == 0; }
+		[[nodiscard]] const char32_t *chars() const { return data_; }
+		[[nodiscard]] Node *operator[](const size_t pos) const { return Nodes()[pos]; }
+		[[nodiscard]] Node *const *begin() const { return Nodes(); }
+		[[nodiscard]] Node *const *end() const { return Nodes() + size_; }
+
+		void Insert(size_t pos, Node *node);
+		/**
+		 * Adds nodes sorted by chr, none of them with the chr of a child already here
+		 */
+		void Insert(const std::vector <Node *> &nodes);
+		void clear();
+	};
+
 	struct Node {
-		std::vector <Node *> children;
+		Children children;
 		FreqToken val;
 		char32_t chr;
 		uint32_t sub_size = 1;
 
 		explicit Node(const char32_t chr) : chr(chr) {}
+		Node(Node &&other) noexcept = default;
 		~Node ();
 
 		[[nodiscard]] size_t FindChild(char32_t chd_chr) const;
@@ -39,6 +79,9 @@ class annealing::Trie {
 	Node root_ = Node(0);
 
 public:
+	// Heap bytes each node takes: itself, its char and pointer in the parent and the allocator's header
+	static constexpr size_t kNodeBytes = sizeof(Node) + sizeof(char32_t) + sizeof(Node *) + 16;
+
 	[[nodiscard]] uint64_t total() const { return root_.val.freq; }
 	[[nodiscard]] uint64_t size() const { return root_.sub_size; }
 
@@ -48,5 +91,11 @@ public:
 
 	void Merge (Trie &from);
 
+	/**
+	 * @return How many of the sorted chars are less than chr, the search FindChild does, with the kernel of a given
+	 * level rather than the best one. To check kernels against each other. Levels above GetSimdLevel use its kernel.
+	 */
+	static size_t CountLess(const char32_t *chars, size_t size, char32_t chr, SimdLevel level);
+
 	std::vector <Token> BuildTokens ();
 };
\ No newline at end of file
@@ -0,0 +1,50 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <string>
+
+#include "../files/SolutionFile.h"
+
+// Bytes per line of the generated string literal
+constexpr size_t kLineBytes = 32;
+
+// Writes the image as one string literal with octal escapes, which compilers handle much faster than a list of
+// integers. An array of char initialized from a literal also keeps the image in read-only data, shared by every process.
+void WriteSource(std::ostream &out, const std::string &json_path, const std::span <const char> image) {
+	out << "// Generated by vocabgen from " << json_path << ". Do not edit.\n\n";
+	out << "#include <span>\n\n";
+	out << "alignas(8) static constexpr char kImage[] =\n";
+	char escape[8];
+	for (size_t begin = 0; begin < image.size(); begin += kLineBytes) {
+		out << "\t\"";
+		for (size_t pos = begin; pos < std::min(image.size(), begin + kLineBytes); pos++) {
+			snprintf(escape, sizeof escape, "\\%03o", (unsigned char)image[pos]);
+			out << escape;
+		}
+		out << "\"\n";
+	}
+	out << ";\n\n";
+	out << "std::span <const char> GetFrozenVocab() {\n";
+	out << "\treturn {kImage, sizeof kImage - 1};\n";
+	out << "}\n";
+}
+
+int main(const int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " <.tokens.json> <output.cpp>" << std::endl;
+		return 2;
+	}
+	const SolutionFile vocab(argv[1]);
+	if (!vocab.GetVocab().IsValid()) {
+		std::cerr << "Cannot load vocabulary " << argv[1] << std::endl;
+		return 1;
+	}
+	std::ofstream out(argv[2], std::ios::trunc);
+	WriteSource(out, argv[1], vocab.GetVocab().GetImage());
+	out.close();
+	if (!out.good()) {
+		std::cerr << "Cannot write " << argv[2] << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,33 @@
+#include "CpuFeatures.h"
+
+#include <cstdlib>
+#include <cstring>
+
+constexpr const char *kNames[] = {"scalar", "sse2", "avx2", "avx512"};
+
+SimdLevel DetectSimdLevel() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512bw")) return AVX512;
+	if (__builtin_cpu_supports("avx2")) return AVX2;
+	if (__builtin_cpu_supports("sse2")) return SSE2;
+#endif
+	return SCALAR;
+}
+
+SimdLevel GetSimdLevel() {
+	static const SimdLevel level = [] {
+		SimdLevel detected = DetectSimdLevel();
+		if (const char *cap = getenv("TOKENIZER_SIMD")) {
+			for (int i = SCALAR; i < detected; i++) {
+				if (strcmp(cap, kNames[i]) == 0) detected = (SimdLevel)i;
+			}
+		}
+		return detected;
+	}();
+	return level;
+}
+
+const char *GetSimdName(const SimdLevel level) {
+	return kNames[level];
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+/**
+ * The widest vector extension the running CPU supports, in increasing order. The build targets the baseline
+ * architecture, and kernels compiled for wider extensions with __attribute__((target)) are picked by this at runtime,
+ * so a single binary runs the fastest code each host has.
+ */
+enum SimdLevel {
+	SCALAR,
+	SSE2,
+	AVX2,
+	AVX512 // with the BW extension for byte lanes
+};
+
+/**
+ * Read with cpuid on the first call, which also checks that the OS saves the wide registers.
+ * The TOKENIZER_SIMD environment variable (scalar, sse2, avx2 or avx512) caps the level, to compare kernels.
+ */
+[[nodiscard]] SimdLevel GetSimdLevel();
+
+[[nodiscard]] const char *GetSimdName(SimdLevel level);
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * MurmurHash64A by Austin Appleby, for short keys such as tokens. Unaligned input is read with memcpy.
+ */
+inline uint64_t MurmurHash64A(const void *key, const size_t len, const uint64_t seed) {
+	constexpr uint64_t kMul = 0xC6A4A7935BD1E995ULL;
+	constexpr int kShift = 47;
+
+	const auto *data = (const unsigned char *)key;
+	const unsigned char *end = data + (len & ~(size_t)7);
+	uint64_t hash = seed ^ (len * kMul);
+	for (; data != end; data += 8) {
+		uint64_t block;
+		memcpy(&block, data, 8);
+		block *= kMul;
+		block ^= block >> kShift;
+		block *= kMul;
+		hash ^= block;
+		hash *= kMul;
+	}
+	switch (len & 7) {
+	case 7: hash ^= (uint64_t)data[6] << 48; [[fallthrough]];
+	case 6: hash ^= (uint64_t)data[5] << 40; [[fallthrough]];
+	case 5: hash ^= (uint64_t)data[4] << 32; [[fallthrough]];
+	case 4: hash ^= (uint64_t)data[3] << 24; [[fallthrough]];
+	case 3: hash ^= (uint64_t)data[2] << 16; [[fallthrough]];
+	case 2: hash ^= (uint64_t)data[1] << 8; [[fallthrough]];
+	case 1: hash ^= (uint64_t)data[0];
+		hash *= kMul;
+	default: break;
+	}
+	hash ^= hash >> kShift;
+	hash *= kMul;
+	hash ^= hash >> kShift;
+	return hash;
+}
+
+/**
+ * Final avalanche of MurmurHash3, a bijection that spreads every input bit over the whole word
+ */
+inline uint64_t Fmix64(uint64_t hash) {
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+struct Hash128 {
+	uint64_t low;
+	uint64_t high;
+
+	bool operator==(const Hash128 &other) const = default;
+};
+
+/**
+ * MurmurHash3_x64_128 by Austin Appleby, for whole documents. Collisions are as unlikely as for any 128 bit hash.
+ */
+inline Hash128 MurmurHash3(const void *key, const size_t len, const uint64_t seed) {
+	constexpr uint64_t kC1 = 0x87C37B91114253D5ULL;
+	constexpr uint64_t kC2 = 0x4CF5AD432745937FULL;
+	const auto rotl = [](const uint64_t x, const int r) { return (x << r) | (x >> (64 - r)); };
+
+	const auto *data = (const unsigned char *)key;
+	const size_t block_cnt = len / 16;
+	uint64_t h1 = seed;
+	uint64_t h2 = seed;
+	for (size_t block = 0; block < block_cnt; block++) {
+		uint64_t k1, k2;
+		memcpy(&k1, data + 16 * block, 8);
+		memcpy(&k2, data + 16 * block + 8, 8);
+		k1 *= kC1; k1 = rotl(k1, 31); k1 *= kC2; h1 ^= k1;
+		h1 = rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52DCE729;
+		k2 *= kC2; k2 = rotl(k2, 33); k2 *= kC1; h2 ^= k2;
+		h2 = rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495AB5;
+	}
+
+	const unsigned char *tail = data + 16 * block_cnt;
+	uint64_t k1 = 0;
+	uint64_t k2 = 0;
+	switch (len & 15) {
+	case 15: k2 ^= (uint64_t)tail[14] << 48; [[fallthrough]];
+	case 14: k2 ^= (uint64_t)tail[13] << 40; [[fallthrough]];
+	case 13: k2 ^= (uint64_t)tail[12] << 32; [[fallthrough]];
+	case 12: k2 ^= (uint64_t)tail[11] << 24; [[fallthrough]];
+	case 11: k2 ^= (uint64_t)tail[10] << 16; [[fallthrough]];
+	case 10: k2 ^= (uint64_t)tail[9] << 8; [[fallthrough]];
+	case 9: k2 ^= (uint64_t)tail[8];
+		k2 *= kC2; k2 = rotl(k2, 33); k2 *= kC1; h2 ^= k2;
+		[[fallthrough]];
+	case 8: k1 ^= (uint64_t)tail[7] << 56; [[fallthrough]];
+	case 7: k1 ^= (uint64_t)tail[6] << 48; [[fallthrough]];
+	case 6: k1 ^= (uint64_t)tail[5] << 40; [[fallthrough]];
+	case 5: k1 ^= (uint64_t)tail[4] << 32; [[fallthrough]];
+	case 4: k1 ^= (uint64_t)tail[3] << 24; [[fallthrough]];
+	case 3: k1 ^= (uint64_t)tail[2] << 16; [[fallthrough]];
+	case 2: k1 ^= (uint64_t)tail[1] << 8; [[fallthrough]];
+	case 1: k1 ^= (uint64_t)tail[0];
+		k1 *= kC1; k1 = rotl(k1, 31); k1 *= kC2; h1 ^= k1;
+	default: break;
+	}
+
+	h1 ^= len;
+	h2 ^= len;
+	h1 += h2;
+	h2 += h1;
+	h1 = Fmix64(h1);
+	h2 = Fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+	return {h1, h2};
+}
+
+/**
+ * Maps a uniform 64 bit hash onto [0, range) with a multiply instead of a division
+ */
+inline size_t ReduceRange(const uint64_t hash, const size_t range) {
+	return (size_t)(((unsigned __int128)hash * range) >> 64);
+}
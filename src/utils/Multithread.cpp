@@ -155,13 +155,16 @@ ThreadPool::TaskRef ThreadPool::Enqueue(std::function <void()> &&func, std::vect
 
 void ThreadPool::Wait(std::vector <TaskRef> &&tasks) {
 #ifndef SINGLETHREAD_DEBUG
+	std::mutex mutex;
 	std::condition_variable wait_done;
-	Enqueue([&wait_done] {
+	bool done = false;
+	Enqueue([&mutex, &wait_done, &done] {
+		std::lock_guard lock(mutex);
+		done = true;
 		wait_done.notify_one();
 	}, std::move(tasks));
-	std::mutex mutex;
 	std::unique_lock lock(mutex);
-	wait_done.wait(lock);
+	wait_done.wait(lock, [&done] { return done; });
 #endif
 }
 void ThreadPool::Wait() {
@@ -56,6 +56,8 @@ public:
 	explicit ThreadPool (size_t size = std::thread::hardware_concurrency());
 	~ThreadPool ();
 
+	[[nodiscard]] size_t size() const { return threads_.size(); }
+
 	TaskRef Enqueue(std::function <void()> &&func, std::vector <TaskRef> &&dependencies);
 	TaskRef Enqueue(std::function <void()> &&func) { return Enqueue(std::move(func), {}); }
 